@@ -0,0 +1,189 @@
+// Benchmark for big_integer as a hash and ordered key: std::hash against
+// hashing the decimal string it replaces, equality of equal and unequal
+// values, operator<, and unordered_map / sorting built on them. Build it
+// together with big_integer.cpp. Prints one tab-separated line per
+// configuration:
+//
+//   op limbs count seconds ns_per_op
+//
+// Keys are random positive and negative numbers of the given number of
+// 32-bit limbs; "equal" compares each key with a separate copy of itself,
+// "unequal" with a key that differs only in its lowest limb, which is the
+// worst case for a comparison. Each timing is the best of --repeat runs.
+
+#include "big_integer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+char const usage[] = "Error. Expected [--limbs <n>,...] [--count <n>] [--repeat <n>]";
+
+struct options {
+  std::vector<size_t> limbs = {1, 2, 4, 16, 64};
+  size_t count = 100000;
+  size_t repeat = 3;
+};
+
+bool parse_list(char const* s, std::vector<size_t>& values) {
+  values.clear();
+  for (;;) {
+    char* end;
+    unsigned long long v = std::strtoull(s, &end, 10);
+    if (end == s || v == 0) {
+      return false;
+    }
+    values.push_back(v);
+    if (*end == '\0') {
+      return true;
+    }
+    if (*end != ',') {
+      return false;
+    }
+    s = end + 1;
+  }
+}
+
+bool parse_options(int argc, char** argv, options& opt) {
+  std::vector<size_t> single;
+  for (int i = 1; i < argc; i++) {
+    bool ok = i + 1 < argc;
+    if (ok && std::strcmp(argv[i], "--limbs") == 0) {
+      ok = parse_list(argv[++i], opt.limbs);
+    } else if (ok && std::strcmp(argv[i], "--count") == 0) {
+      ok = parse_list(argv[++i], single) && single.size() == 1;
+      opt.count = ok ? single[0] : 0;
+    } else if (ok && std::strcmp(argv[i], "--repeat") == 0) {
+      ok = parse_list(argv[++i], single) && single.size() == 1;
+      opt.repeat = ok ? single[0] : 0;
+    } else {
+      ok = false;
+    }
+    if (!ok) {
+      std::perror(usage);
+      return false;
+    }
+  }
+  return true;
+}
+
+// A random number of exactly `limbs` limbs, negative half of the time.
+big_integer random_number(std::mt19937& rng, size_t limbs) {
+  big_integer res(rng() | 1u);
+  for (size_t i = 1; i < limbs; i++) {
+    res <<= 32;
+    res += big_integer(static_cast<unsigned>(rng()));
+  }
+  return rng() % 2 ? -res : res;
+}
+
+// Keeps the compiler from dropping a result that is never read.
+template <typename T>
+void escape(T const& value) {
+  asm volatile("" : : "r"(&value) : "memory");
+}
+
+template <typename F>
+double best_of(size_t repeat, F f) {
+  double best = 1e100;
+  for (size_t r = 0; r < repeat; r++) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+  }
+  return best;
+}
+
+void report(char const* op, size_t limbs, size_t count, double seconds) {
+  std::printf("%s\t%zu\t%zu\t%.6f\t%.1f\n", op, limbs, count, seconds, seconds / count * 1e9);
+  std::fflush(stdout);
+}
+
+void run(options const& opt, size_t limbs) {
+  std::mt19937 rng(static_cast<unsigned>(limbs));
+  std::vector<big_integer> keys;
+  std::vector<big_integer> copies;
+  std::vector<big_integer> neighbours;
+  for (size_t i = 0; i < opt.count; i++) {
+    keys.push_back(random_number(rng, limbs));
+    // built by arithmetic, so it does not share anything with the key
+    copies.push_back(keys.back() + 1 - 1);
+    neighbours.push_back(keys.back() + 1);
+  }
+  size_t n = opt.count;
+
+  report("hash", limbs, n, best_of(opt.repeat, [&] {
+           size_t h = 0;
+           for (big_integer const& k : keys) {
+             h ^= std::hash<big_integer>()(k);
+           }
+           escape(h);
+         }));
+  report("hash_string", limbs, n, best_of(opt.repeat, [&] {
+           size_t h = 0;
+           for (big_integer const& k : keys) {
+             h ^= std::hash<std::string>()(to_string(k));
+           }
+           escape(h);
+         }));
+  report("equal", limbs, n, best_of(opt.repeat, [&] {
+           size_t same = 0;
+           for (size_t i = 0; i < n; i++) {
+             same += keys[i] == copies[i];
+           }
+           escape(same);
+         }));
+  report("unequal", limbs, n, best_of(opt.repeat, [&] {
+           size_t same = 0;
+           for (size_t i = 0; i < n; i++) {
+             same += keys[i] == neighbours[i];
+           }
+           escape(same);
+         }));
+  report("less", limbs, n, best_of(opt.repeat, [&] {
+           size_t less = 0;
+           for (size_t i = 0; i < n; i++) {
+             less += keys[i] < neighbours[i];
+           }
+           escape(less);
+         }));
+  report("map_insert_find", limbs, n, best_of(opt.repeat, [&] {
+           std::unordered_map<big_integer, size_t> map;
+           for (size_t i = 0; i < n; i++) {
+             map.emplace(keys[i], i);
+           }
+           size_t found = 0;
+           for (big_integer const& c : copies) {
+             found += map.count(c);
+           }
+           escape(found);
+         }));
+  report("sort", limbs, n, best_of(opt.repeat, [&] {
+           std::vector<big_integer> sorted = keys;
+           std::sort(sorted.begin(), sorted.end());
+           escape(sorted);
+         }));
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  options opt;
+  if (!parse_options(argc, argv, opt)) {
+    return -1;
+  }
+  std::printf("op\tlimbs\tcount\tseconds\tns_per_op\n");
+  for (size_t limbs : opt.limbs) {
+    run(opt, limbs);
+  }
+  return 0;
+}
@@ -1,15 +1,125 @@
 #include "big_integer.h"
 #include <algorithm>
+#include <array>
 #include <cassert>
 #include <cstddef>
 #include <cstring>
 #include <iostream>
+#include <memory>
 #include <ostream>
 #include <stdexcept>
+#include <utility>
 
 static const uint32_t BASE_32 = 32;
 static const uint64_t BASE = (1ull << BASE_32);
 
+namespace {
+// Per-thread bump allocator for limb buffers of internal temporaries.
+// Chunks are kept between operations, so steady-state use does not touch
+// the global allocator at all.
+class scratch_arena {
+public:
+  struct marker {
+    size_t chunk;
+    size_t used;
+  };
+
+  marker mark() const {
+    return {current_, used_};
+  }
+
+  void release(marker m) {
+    current_ = m.chunk;
+    used_ = m.used;
+  }
+
+  uint32_t* allocate(size_t n) {
+    while (current_ < chunks_.size() && used_ + n > chunks_[current_].size) {
+      current_++;
+      used_ = 0;
+    }
+    if (current_ == chunks_.size()) {
+      size_t sz = std::max(n, chunks_.empty() ? MIN_CHUNK : chunks_.back().size * 2);
+      chunks_.push_back({std::make_unique<uint32_t[]>(sz), sz});
+    }
+    uint32_t* res = chunks_[current_].data.get() + used_;
+    used_ += n;
+    return res;
+  }
+
+private:
+  static const size_t MIN_CHUNK = 1024;
+
+  struct chunk {
+    std::unique_ptr<uint32_t[]> data;
+    size_t size;
+  };
+
+  std::vector<chunk> chunks_;
+  size_t current_ = 0;
+  size_t used_ = 0;
+};
+
+thread_local scratch_arena arena;
+
+// Everything allocated through a scratch is released in bulk when the
+// top-level operation that created it returns.
+class scratch {
+public:
+  scratch() : mark_(arena.mark()) {}
+  scratch(scratch const&) = delete;
+  scratch& operator=(scratch const&) = delete;
+  ~scratch() {
+    arena.release(mark_);
+  }
+
+  uint32_t* allocate(size_t n) {
+    return arena.allocate(n);
+  }
+
+private:
+  scratch_arena::marker mark_;
+};
+
+// Fully unrolled schoolbook products for operands of up to MAX_FIXED_MUL
+// limbs, which is what most multiplications are. One kernel per pair of
+// sizes; mul_kernels is indexed by (n - 1) * MAX_FIXED_MUL + (m - 1).
+const size_t MAX_FIXED_MUL = 8;
+
+using mul_kernel = void (*)(uint32_t const*, uint32_t const*, uint32_t*);
+
+// out[0, M) += a * b[0, M); returns the carry out of the top limb.
+template <size_t... J>
+inline uint32_t mul_row(uint32_t a, uint32_t const* b, uint32_t* out,
+                        std::index_sequence<J...>) {
+  uint64_t carry = 0;
+  ((carry += static_cast<uint64_t>(a) * b[J] + out[J], out[J] = static_cast<uint32_t>(carry),
+    carry >>= BASE_32),
+   ...);
+  return static_cast<uint32_t>(carry);
+}
+
+// out[0, N + M) = a[0, N) * b[0, M)
+template <size_t N, size_t M, size_t... I>
+void mul_fixed(uint32_t const* a, uint32_t const* b, uint32_t* out, std::index_sequence<I...>) {
+  std::fill(out, out + M, 0);
+  ((out[I + M] = mul_row(a[I], b, out + I, std::make_index_sequence<M>())), ...);
+}
+
+template <size_t N, size_t M>
+void mul_fixed(uint32_t const* a, uint32_t const* b, uint32_t* out) {
+  mul_fixed<N, M>(a, b, out, std::make_index_sequence<N>());
+}
+
+template <size_t... K>
+constexpr std::array<mul_kernel, sizeof...(K)> make_mul_kernels(std::index_sequence<K...>) {
+  return {&mul_fixed<K / MAX_FIXED_MUL + 1, K % MAX_FIXED_MUL + 1>...};
+}
+
+constexpr std::array<mul_kernel, MAX_FIXED_MUL * MAX_FIXED_MUL> mul_kernels =
+    make_mul_kernels(std::make_index_sequence<MAX_FIXED_MUL * MAX_FIXED_MUL>());
+} // namespace
+
 big_integer::big_integer() : sign(false) {}
 
 big_integer::big_integer(big_integer const& other) = default;
@@ -68,18 +178,17 @@ big_integer::big_integer(std::string const& str) : big_integer() {
   size_t iter = str[0] == '-';
   bool save_sign = iter;
   static const size_t block_size = 8;
-  static const big_integer BLOCK = big_integer(100000000);
-  static const big_integer TEN = big_integer(10);
+  static const uint32_t BLOCK = 100000000;
+  val.reserve((str.size() - iter) / 9 + 1);
   for (; iter + block_size < str.size(); iter += block_size) {
-    *this *= BLOCK;
-    sum_long_short(read_block(str, iter, iter + block_size));
+    mul_add_short(BLOCK, read_block(str, iter, iter + block_size));
   }
   if (iter < str.size()) {
-    *this *= TEN;
-    for (size_t j = 1; iter + j < str.size(); j++) {
-      *this *= TEN;
+    uint32_t mul = 1;
+    for (size_t j = iter; j < str.size(); j++) {
+      mul *= 10;
     }
-    *this += read_block(str, iter, str.size());
+    mul_add_short(mul, read_block(str, iter, str.size()));
   }
   sign = save_sign;
   clean_up();
@@ -149,7 +258,7 @@ big_integer operator+(big_integer a, big_integer const& b) {
 
 big_integer& big_integer::operator+=(big_integer const& rhs) {
   if (sign ^ rhs.sign) {
-    if (abs(*this) > abs(rhs)) {
+    if (compare_abs(*this, rhs) > 0) {
       sum_with_coef(1, -1, rhs);
     } else {
       sign = rhs.sign;
@@ -167,7 +276,7 @@ big_integer operator-(big_integer a, big_integer const& b) {
 
 big_integer& big_integer::operator-=(big_integer const& rhs) {
   if (sign ^ !rhs.sign) {
-    if (abs(*this) > abs(rhs)) {
+    if (compare_abs(*this, rhs) > 0) {
       sum_with_coef(1, -1, rhs);
     } else {
       sign = !rhs.sign;
@@ -183,21 +292,39 @@ big_integer operator*(big_integer a, big_integer const& b) {
   return a *= b;
 }
 
+// The product is built outside val and then copied over it, so val keeps
+// its buffer and rhs may alias *this. Small operands use an unrolled
+// kernel and a stack buffer; larger ones the scratch arena.
 big_integer& big_integer::operator*=(big_integer const& rhs) {
-  big_integer result;
-  result.val = std::vector<uint32_t>(size() + rhs.size() + 1, 0);
-  result.sign = sign ^ rhs.sign;
-  for (int i = 0; i < size(); i++) {
+  size_t n = size(), m = rhs.size();
+  if (n == 0 || m == 0) {
+    val.clear();
+    sign = false;
+    return *this;
+  }
+  if (n <= MAX_FIXED_MUL && m <= MAX_FIXED_MUL) {
+    uint32_t product[2 * MAX_FIXED_MUL];
+    mul_kernels[(n - 1) * MAX_FIXED_MUL + (m - 1)](val.data(), rhs.val.data(), product);
+    // the product of normalized operands has n + m or n + m - 1 limbs
+    val.assign(product, product + n + m - (product[n + m - 1] == 0));
+    sign ^= rhs.sign;
+    return *this;
+  }
+  scratch tmp;
+  uint32_t* product = tmp.allocate(n + m);
+  std::fill(product, product + m, 0);
+  for (size_t i = 0; i < n; i++) {
     uint64_t left = 0;
-    for (int j = 0; j < rhs.size(); j++) {
-      left += static_cast<uint64_t>(val[i]) * rhs[j] + result[i + j];
-      result[i + j] = left & (BASE - 1);
+    for (size_t j = 0; j < m; j++) {
+      left += static_cast<uint64_t>(val[i]) * rhs[j] + product[i + j];
+      product[i + j] = left & (BASE - 1);
       left >>= BASE_32;
     }
-    result[i + rhs.size()] = left & (BASE - 1);
+    product[i + m] = left & (BASE - 1);
   }
-  result.clean_up();
-  swap(result);
+  val.assign(product, product + n + m);
+  sign ^= rhs.sign;
+  clean_up();
   return *this;
 }
 
@@ -228,33 +355,28 @@ big_integer& big_integer::operator^=(big_integer const& rhs) {
   return *this;
 }
 
-big_integer big_integer::two_compl(const big_integer& a) {
-  if (!a.sign) {
-    return a;
-  }
-  big_integer result;
-  result.val.resize(a.size(), 0);
-  for (size_t i = 0; i < a.size(); i++) {
-    result[i] = ~a[i];
-  }
-  result++;
-  result.sign = true;
-  return result;
-}
-
+// Two's complement of both operands and of the result is produced limb by
+// limb with running carries, so no temporary big_integers are needed.
 template <typename Func>
 void big_integer::bit_op(const big_integer& a, const Func& function) {
-  uint32_t save_sign = sign;
-  big_integer this_compl = two_compl(*this);
-  big_integer a_compl = two_compl(a);
-
-  size_t n = std::max(this_compl.size(), a_compl.size());
-  val.resize(n);
+  bool a_sign = a.sign;
+  bool res_sign = function(sign ? BASE - 1 : 0, a_sign ? BASE - 1 : 0) != 0;
+  size_t n = std::max(size(), a.size()) + 1;
+  val.resize(n, 0);
+  uint64_t this_carry = sign, a_carry = a_sign, res_carry = res_sign;
   for (size_t i = 0; i < n; i++) {
-    val[i] = function(this_compl.get(i, BASE - 1), a_compl.get(i, BASE - 1));
+    uint64_t x = (sign ? ~get(i) & (BASE - 1) : get(i)) + this_carry;
+    uint64_t y = (a_sign ? ~a.get(i) & (BASE - 1) : a.get(i)) + a_carry;
+    this_carry = x >> BASE_32;
+    a_carry = y >> BASE_32;
+    uint64_t r = function(x & (BASE - 1), y & (BASE - 1));
+    if (res_sign) {
+      r = (~r & (BASE - 1)) + res_carry;
+      res_carry = r >> BASE_32;
+    }
+    val[i] = r & (BASE - 1);
   }
-  sign = function(save_sign, a.sign);
-  *this = two_compl(*this);
+  sign = res_sign;
   clean_up();
 }
 
@@ -274,7 +396,7 @@ big_integer& big_integer::operator<<=(int rhs) {
   bool save_sign = sign;
   uint32_t shft = std::abs(rhs) % BASE_32, zer = std::abs(rhs) / BASE_32;
   if (rhs >= 0) {
-    *this = mul_long_short(1ull << shft);
+    mul_add_short(1u << shft, 0);
     val.insert(val.begin(), zer, 0);
   } else {
     val.erase(val.begin(), val.begin() + std::min(size(), static_cast<size_t>(zer)));
@@ -285,25 +407,31 @@ big_integer& big_integer::operator<<=(int rhs) {
   return *this;
 }
 
-bool operator==(big_integer const& a, big_integer const& b) {
-  if ((a.sign ^ b.sign) || a.size() != b.size()) {
-    return false;
+int big_integer::compare_abs(big_integer const& a, big_integer const& b) {
+  if (a.size() != b.size()) {
+    return a.size() < b.size() ? -1 : 1;
+  }
+  for (size_t i = a.size(); i > 0; i--) {
+    if (a[i - 1] != b[i - 1]) {
+      return a[i - 1] < b[i - 1] ? -1 : 1;
+    }
   }
-  return a.val == b.val;
+  return 0;
 }
 
-bool operator>(big_integer const& a, big_integer const& b) {
+int big_integer::compare(big_integer const& a, big_integer const& b) {
   if (a.sign != b.sign) {
-    return b.sign;
-  } else if (a.size() != b.size()) {
-    return a.sign ^ (a.size() > b.size());
+    return a.sign ? -1 : 1;
   }
-  for (size_t i = a.size(); i > 0; i--) {
-    if (a[i - 1] != b[i - 1]) {
-      return a.sign ^ (a[i - 1] > b[i - 1]);
-    }
+  return a.sign ? -compare_abs(a, b) : compare_abs(a, b);
+}
+
+bool operator==(big_integer const& a, big_integer const& b) {
+  if (a.sign != b.sign || a.size() != b.size()) {
+    return false;
   }
-  return false;
+  return a.size() == 0 ||
+         std::memcmp(a.val.data(), b.val.data(), a.size() * sizeof(uint32_t)) == 0;
 }
 
 bool operator!=(big_integer const& a, big_integer const& b) {
@@ -311,30 +439,34 @@ bool operator!=(big_integer const& a, big_integer const& b) {
 }
 
 bool operator<(big_integer const& a, big_integer const& b) {
-  return b > a;
+  return big_integer::compare(a, b) < 0;
+}
+
+bool operator>(big_integer const& a, big_integer const& b) {
+  return big_integer::compare(a, b) > 0;
 }
 
 bool operator<=(big_integer const& a, big_integer const& b) {
-  return !(a > b);
+  return big_integer::compare(a, b) <= 0;
 }
 
 bool operator>=(big_integer const& a, big_integer const& b) {
-  return !(a < b);
+  return big_integer::compare(a, b) >= 0;
 }
 
 std::string to_string(big_integer const& a) {
   std::string ans;
   big_integer copy = a;
   static const size_t block_size = 9;
-  static const big_integer BLOCK(1000000000);
+  static const uint32_t BLOCK = 1000000000;
+  ans.reserve(a.size() * 10 + 1);
   do {
-    uint32_t cur = (copy % BLOCK).get(0);
+    uint32_t cur = copy.div_long_short(BLOCK);
     size_t len = 0;
     for (; cur > 0; cur /= 10, len++) {
       ans.push_back('0' + cur % 10);
     }
     ans.resize(ans.size() + block_size - len, '0');
-    copy /= BLOCK;
   } while (copy.size());
   while (ans.size() > 1 && ans[ans.size() - 1] == '0') {
     ans.pop_back();
@@ -350,6 +482,25 @@ std::ostream& operator<<(std::ostream& s, big_integer const& a) {
   return s << to_string(a);
 }
 
+// Hashes limbs two at a time with a multiply-xorshift mixer, so no decimal
+// conversion is needed to use big_integer as an unordered_map key.
+size_t std::hash<big_integer>::operator()(big_integer const& a) const noexcept {
+  static const uint64_t MUL = 0x9e3779b97f4a7c15ull;
+  uint64_t h = (a.size() << 1) | a.sign;
+  size_t i = 0;
+  for (; i + 1 < a.size(); i += 2) {
+    uint64_t word = (static_cast<uint64_t>(a[i + 1]) << BASE_32) | a[i];
+    h = (h ^ word) * MUL;
+    h ^= h >> 29;
+  }
+  if (i < a.size()) {
+    h = (h ^ a[i]) * MUL;
+    h ^= h >> 29;
+  }
+  h *= MUL;
+  return static_cast<size_t>(h ^ (h >> 32));
+}
+
 void big_integer::clean_up() {
   while (size() > 0 && val.back() == 0) {
     val.pop_back();
@@ -368,16 +519,16 @@ void big_integer::swap(big_integer& other) {
   val.swap(other.val);
 }
 
-big_integer big_integer::mul_long_short(uint32_t c) const {
-  uint64_t left = 0;
-  big_integer result;
-  result.val.resize(size() + 1, 0);
-  for (size_t i = 0; i < result.size(); i++) {
-    left += static_cast<uint64_t>(get(i)) * c;
-    result[i] = left & (BASE - 1);
-    left >>= BASE_32;
+void big_integer::mul_add_short(uint32_t mul, uint32_t add) {
+  uint64_t carry = add;
+  for (size_t i = 0; i < size(); i++) {
+    carry += static_cast<uint64_t>(val[i]) * mul;
+    val[i] = carry & (BASE - 1);
+    carry >>= BASE_32;
+  }
+  if (carry) {
+    val.push_back(carry);
   }
-  return result;
 }
 
 uint32_t big_integer::div_long_short(uint32_t b, bool signd) {
@@ -412,21 +563,26 @@ big_integer::div_mod(const big_integer& rhs) {
     ost.clean_up();
     return {*this, ost};
   }
+  // Normalized divisor and the per-step product live in the scratch arena;
+  // only the quotient and remainder are heap-allocated.
+  scratch tmp;
   uint32_t normalized =
       static_cast<uint64_t>(BASE) / (static_cast<uint64_t>(rhs.val.back()) + 1);
-  *this *= normalized;
-  big_integer divisor = rhs * normalized;
+  size_t k = rhs.size();
+  uint32_t* divisor = tmp.allocate(k);
+  uint32_t* dq = tmp.allocate(k + 1);
+  mul_short(rhs.val.data(), k, normalized, divisor);
+  mul_add_short(normalized, 0);
   val.push_back(0);
-  size_t m = divisor.size() + 1;
-  big_integer ans, dq;
-  ans.val.resize(size() - divisor.size());
-  uint32_t qt = 0;
+  size_t m = k + 1;
+  big_integer ans;
+  ans.val.resize(size() - k);
   for (size_t j = ans.size(); j != 0; j--) {
-    qt = trial(divisor);
-    dq = divisor * qt;
+    uint32_t qt = trial(divisor[k - 1]);
+    dq[k] = mul_short(divisor, k, qt, dq);
     while (smaller(dq, m)) {
       qt--;
-      dq -= divisor;
+      sub_limbs(dq, divisor, k);
     }
     ans[j - 1] = qt;
     difference(dq, m);
@@ -440,28 +596,50 @@ big_integer::div_mod(const big_integer& rhs) {
   return {ans, *this};
 }
 
-uint32_t big_integer::trial(big_integer const& b) {
+uint32_t big_integer::mul_short(uint32_t const* a, size_t n, uint32_t c,
+                                uint32_t* out) {
+  uint64_t carry = 0;
+  for (size_t i = 0; i < n; i++) {
+    carry += static_cast<uint64_t>(a[i]) * c;
+    out[i] = carry & (BASE - 1);
+    carry >>= BASE_32;
+  }
+  return carry;
+}
+
+void big_integer::sub_limbs(uint32_t* a, uint32_t const* b, size_t n) {
+  int64_t borrow = 0;
+  for (size_t i = 0; i < n; i++) {
+    borrow = static_cast<int64_t>(a[i]) - b[i] - borrow;
+    a[i] = (borrow < 0 ? borrow + BASE : borrow);
+    borrow = borrow < 0;
+  }
+  for (size_t i = n; borrow; i++) {
+    borrow = a[i] == 0;
+    a[i]--;
+  }
+}
+
+uint32_t big_integer::trial(uint32_t divisor_top) {
   uint64_t dividend = (static_cast<uint64_t>(val.back()) << BASE_32) |
                       (static_cast<uint64_t>(val[size() - 2]));
-  uint64_t divider = b.get(b.size() - 1);
-
-  return (dividend / divider) & (BASE - 1);
+  return std::min(dividend / divisor_top, BASE - 1);
 }
 
-bool big_integer::smaller(big_integer const& b, size_t m) {
-  for (size_t i = 0; i < size(); i++) {
-    if (val[size() - i - 1] != b.get(m - i - 1)) {
-      return val[size() - i - 1] < b.get(m - i - 1);
+bool big_integer::smaller(uint32_t const* b, size_t m) {
+  for (size_t i = 0; i < m; i++) {
+    if (val[size() - i - 1] != b[m - i - 1]) {
+      return val[size() - i - 1] < b[m - i - 1];
     }
   }
   return false;
 }
 
-void big_integer::difference(big_integer const& b, size_t m) {
+void big_integer::difference(uint32_t const* b, size_t m) {
   int64_t borrow = 0;
   uint64_t start = size() - m;
   for (size_t i = 0; i < m; i++) {
-    borrow = static_cast<int64_t>(get(start + i)) - b.get(i) - borrow;
+    borrow = static_cast<int64_t>(get(start + i)) - b[i] - borrow;
     val[start + i] = (borrow < 0 ? borrow + BASE : borrow);
     borrow = borrow < 0;
   }
@@ -1,10 +1,21 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <iosfwd>
 #include <string>
 #include <vector>
 
+struct big_integer;
+
+namespace std {
+template <>
+struct hash<big_integer> {
+  size_t operator()(big_integer const& a) const noexcept;
+};
+} // namespace std
+
 struct big_integer {
   big_integer();
   big_integer(big_integer const& other);
@@ -50,6 +61,7 @@ struct big_integer {
   friend bool operator>=(big_integer const& a, big_integer const& b);
 
   friend std::string to_string(big_integer const& a);
+  friend struct std::hash<big_integer>;
 
   big_integer abs(big_integer const& a);
   void swap(big_integer& other);
@@ -83,14 +95,18 @@ private:
   template<typename Func>
   void bit_op(big_integer const& a,
               const Func& function);
-  big_integer mul_long_short(uint32_t c) const;
+  void mul_add_short(uint32_t mul, uint32_t add);
   void clean_up();
-  big_integer two_compl(big_integer const& a);
+  static int compare_abs(big_integer const& a, big_integer const& b);
+  static int compare(big_integer const& a, big_integer const& b);
 
   std::pair<big_integer, big_integer> div_mod(big_integer const& rhs);
-  uint32_t trial(big_integer const& b);
-  bool smaller(big_integer const& b, size_t m);
-  void difference(big_integer const& b, size_t m);
+  static uint32_t mul_short(uint32_t const* a, size_t n, uint32_t c,
+                            uint32_t* out);
+  static void sub_limbs(uint32_t* a, uint32_t const* b, size_t n);
+  uint32_t trial(uint32_t divisor_top);
+  bool smaller(uint32_t const* b, size_t m);
+  void difference(uint32_t const* b, size_t m);
   uint32_t div_long_short(uint32_t b, bool signd = false);
 };
 
@@ -0,0 +1,144 @@
+// Behaviour checks for the multiplication of big_integer.cpp: every pair
+// of operand sizes served by the unrolled fixed-size kernels, and the
+// sizes just past them that fall back to the general loop, against a
+// plain schoolbook product computed here. Build it together with
+// big_integer.cpp. Prints every failed check and exits with a non-zero
+// status if any failed.
+
+#include "big_integer.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+void check(bool ok, char const* what, int line) {
+  if (!ok) {
+    std::fprintf(stderr, "check.cpp:%d: check failed: %s\n", line, what);
+    failures++;
+  }
+}
+
+using limbs = std::vector<uint32_t>;
+
+// The reference product, one limb at a time.
+limbs multiply(limbs const& a, limbs const& b) {
+  limbs res(a.size() + b.size());
+  for (size_t i = 0; i < a.size(); i++) {
+    uint64_t carry = 0;
+    for (size_t j = 0; j < b.size(); j++) {
+      uint64_t cur = uint64_t(a[i]) * b[j] + res[i + j] + carry;
+      res[i + j] = static_cast<uint32_t>(cur);
+      carry = cur >> 32;
+    }
+    res[i + b.size()] = static_cast<uint32_t>(carry);
+  }
+  return res;
+}
+
+// Decimal digits of a little-endian magnitude, without big_integer.
+std::string decimal(limbs a, bool negative) {
+  std::string digits;
+  while (std::any_of(a.begin(), a.end(), [](uint32_t x) { return x != 0; })) {
+    uint64_t rem = 0;
+    for (size_t i = a.size(); i-- > 0;) {
+      uint64_t cur = (rem << 32) | a[i];
+      a[i] = static_cast<uint32_t>(cur / 10);
+      rem = cur % 10;
+    }
+    digits.push_back(static_cast<char>('0' + rem));
+  }
+  if (digits.empty()) {
+    return "0";
+  }
+  if (negative) {
+    digits.push_back('-');
+  }
+  std::reverse(digits.begin(), digits.end());
+  return digits;
+}
+
+bool is_zero(limbs const& a) {
+  return std::all_of(a.begin(), a.end(), [](uint32_t x) { return x == 0; });
+}
+
+// Operands of n limbs that exercise the carries differently: every limb
+// at its maximum, random limbs, and a lone top limb over zeros.
+std::vector<limbs> operands(size_t n, std::mt19937& rng) {
+  limbs ones(n, UINT32_MAX);
+  limbs random(n);
+  for (uint32_t& x : random) {
+    x = static_cast<uint32_t>(rng());
+  }
+  random.back() |= 1;
+  limbs sparse(n);
+  sparse.back() = 1;
+  return {ones, random, sparse};
+}
+
+bool multiplies(limbs const& a, bool a_negative, limbs const& b, bool b_negative) {
+  big_integer x(decimal(a, a_negative));
+  big_integer y(decimal(b, b_negative));
+  bool negative = a_negative != b_negative && !is_zero(a) && !is_zero(b);
+  std::string expected = decimal(multiply(a, b), negative);
+  return to_string(x * y) == expected && to_string(y * x) == expected;
+}
+
+void check_sizes() {
+  std::mt19937 rng(48);
+  // 8 limbs is the largest fixed kernel; 9 and 10 take the general loop
+  for (size_t n = 1; n <= 10; n++) {
+    for (size_t m = 1; m <= 10; m++) {
+      bool ok = true;
+      for (limbs const& a : operands(n, rng)) {
+        for (limbs const& b : operands(m, rng)) {
+          for (int signs = 0; signs < 4; signs++) {
+            ok &= multiplies(a, signs & 1, b, signs & 2);
+          }
+        }
+      }
+      if (!ok) {
+        std::fprintf(stderr, "check.cpp: wrong product of %zu by %zu limbs\n", n, m);
+      }
+      CHECK(ok);
+    }
+  }
+}
+
+void check_special() {
+  std::mt19937 rng(7);
+  for (size_t n = 1; n <= 10; n++) {
+    for (limbs const& a : operands(n, rng)) {
+      CHECK(multiplies(a, true, limbs{0}, false));
+      CHECK(multiplies(a, false, limbs{1}, true));
+      // squaring in place reads the operand while it writes the product
+      big_integer x(decimal(a, true));
+      x *= x;
+      CHECK(to_string(x) == decimal(multiply(a, a), false));
+    }
+  }
+  big_integer zero;
+  zero *= big_integer(-5);
+  CHECK(to_string(zero) == "0" && zero == big_integer(0));
+}
+
+} // namespace
+
+int main() {
+  check_sizes();
+  check_special();
+  if (failures != 0) {
+    std::fprintf(stderr, "%d checks failed\n", failures);
+    return -1;
+  }
+  std::printf("all checks passed\n");
+  return 0;
+}
@@ -0,0 +1,203 @@
+// Benchmark for the cost of copy-on-write sharing under the two refcount
+// policies of socow_vector.h. Every thread copies a source vector and
+// drops the copy again (op "copy"), or also writes to the copy, which
+// unshares it (op "unshare"). Op "move" instead moves a copy of the
+// source back and forth, one move construction and one move assignment
+// per op, which never touches the refcount. Prints one tab-separated line
+// per configuration:
+//
+//   policy source threads op size seconds ns_per_op
+//
+// With source "private" each thread has its own source vector, so the
+// refcount is never contended and the line shows the bare cost of the
+// policy. With source "shared" all threads copy one vector, so every copy
+// and release hits the same counter. Only atomic_refcount may be shared
+// across threads, so single_threaded_refcount runs "private" only.
+// ns_per_op is the wall time over the ops done by each thread. Each
+// timing is the best of --repeat runs.
+
+#include "socow_vector.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <latch>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+char const usage[] = "Error. Expected [--threads <n>,...] [--sizes <elements>,...] "
+                     "[--iterations <n>] [--repeat <n>]";
+
+struct options {
+  std::vector<size_t> threads = {1, 2, 4, 8};
+  // 4 elements are stored inline
+  std::vector<size_t> sizes = {4, 64, 4096};
+  size_t iterations = 200000;
+  size_t repeat = 3;
+};
+
+bool parse_list(char const* s, std::vector<size_t>& values) {
+  values.clear();
+  for (;;) {
+    char* end;
+    unsigned long long v = std::strtoull(s, &end, 10);
+    if (end == s || v == 0) {
+      return false;
+    }
+    values.push_back(v);
+    if (*end == '\0') {
+      return true;
+    }
+    if (*end != ',') {
+      return false;
+    }
+    s = end + 1;
+  }
+}
+
+bool parse_options(int argc, char** argv, options& opt) {
+  std::vector<size_t> single;
+  for (int i = 1; i < argc; i++) {
+    bool ok = i + 1 < argc;
+    if (ok && std::strcmp(argv[i], "--threads") == 0) {
+      ok = parse_list(argv[++i], opt.threads);
+    } else if (ok && std::strcmp(argv[i], "--sizes") == 0) {
+      ok = parse_list(argv[++i], opt.sizes);
+    } else if (ok && std::strcmp(argv[i], "--iterations") == 0) {
+      ok = parse_list(argv[++i], single) && single.size() == 1;
+      opt.iterations = ok ? single[0] : 0;
+    } else if (ok && std::strcmp(argv[i], "--repeat") == 0) {
+      ok = parse_list(argv[++i], single) && single.size() == 1;
+      opt.repeat = ok ? single[0] : 0;
+    } else {
+      ok = false;
+    }
+    if (!ok) {
+      std::perror(usage);
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename RefCount>
+using vec = socow_vector<uint64_t, 4, RefCount>;
+
+// Keeps the compiler from dropping a copy that is never read.
+template <typename T>
+void escape(T const& value) {
+  asm volatile("" : : "r"(&value) : "memory");
+}
+
+enum class op { copy, unshare, move };
+
+char const* op_name(op o) {
+  return o == op::copy ? "copy" : o == op::unshare ? "unshare" : "move";
+}
+
+template <typename RefCount>
+vec<RefCount> make_source(size_t size) {
+  vec<RefCount> v;
+  for (size_t i = 0; i < size; i++) {
+    v.push_back(i);
+  }
+  return v;
+}
+
+// Best wall time over opt.repeat runs of `threads` threads doing
+// opt.iterations ops each.
+template <typename RefCount>
+double run(options const& opt, size_t threads, size_t size, bool shared, op o) {
+  double best = 1e100;
+  for (size_t r = 0; r < opt.repeat; r++) {
+    std::vector<vec<RefCount>> sources(shared ? 1 : threads, make_source<RefCount>(size));
+    if (!shared) {
+      // the fill constructor shared one buffer; give each thread its own
+      for (vec<RefCount>& source : sources) {
+        source.mutable_span();
+      }
+    }
+    std::latch start(threads + 1);
+    std::vector<std::thread> workers;
+    uint64_t sink = 0;
+    std::vector<uint64_t> sinks(threads);
+    for (size_t t = 0; t < threads; t++) {
+      workers.emplace_back([&, t] {
+        vec<RefCount> const& source = sources[shared ? 0 : t];
+        uint64_t local = 0;
+        vec<RefCount> own(source);
+        start.arrive_and_wait();
+        if (o == op::move) {
+          for (size_t i = 0; i < opt.iterations; i++) {
+            vec<RefCount> moved(std::move(own));
+            escape(moved);
+            own = std::move(moved);
+            escape(own);
+            local += own.size();
+          }
+        } else {
+          for (size_t i = 0; i < opt.iterations; i++) {
+            vec<RefCount> copy(source);
+            if (o == op::unshare) {
+              copy[0] = i;
+            }
+            escape(copy);
+            local += copy.size();
+          }
+        }
+        sinks[t] = local;
+      });
+    }
+    // the workers may be done before this thread runs again, so the clock
+    // starts before they are released
+    auto begin = std::chrono::steady_clock::now();
+    start.arrive_and_wait();
+    for (std::thread& w : workers) {
+      w.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    for (uint64_t s : sinks) {
+      sink += s;
+    }
+    if (sink != threads * opt.iterations * size) {
+      std::fprintf(stderr, "Error. Lost elements\n");
+      std::exit(-1);
+    }
+    best = std::min(best, seconds);
+  }
+  return best;
+}
+
+template <typename RefCount>
+void report(options const& opt, char const* policy, bool shared) {
+  for (size_t threads : opt.threads) {
+    for (size_t size : opt.sizes) {
+      for (op o : {op::copy, op::unshare, op::move}) {
+        double seconds = run<RefCount>(opt, threads, size, shared, o);
+        std::printf("%s\t%s\t%zu\t%s\t%zu\t%.6f\t%.1f\n", policy, shared ? "shared" : "private",
+                    threads, op_name(o), size, seconds, seconds / opt.iterations * 1e9);
+        std::fflush(stdout);
+      }
+    }
+  }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  options opt;
+  if (!parse_options(argc, argv, opt)) {
+    return -1;
+  }
+  std::printf("policy\tsource\tthreads\top\tsize\tseconds\tns_per_op\n");
+  report<single_threaded_refcount>(opt, "single_threaded", false);
+  report<atomic_refcount>(opt, "atomic", false);
+  report<atomic_refcount>(opt, "atomic", true);
+  return 0;
+}
@@ -0,0 +1,372 @@
+// Behaviour checks for socow_vector.h and persistent_vector.h: when copies
+// share storage, what a mutation unshares, and the size word that also
+// holds socow_vector's dynamic flag. Prints every failed check and exits
+// with a non-zero status if any failed.
+
+// before the headers, so the unshare counters are live
+#define CONTAINER_TELEMETRY
+
+#include "persistent_vector.h"
+#include "socow_vector.h"
+
+#include <cstdio>
+#include <list>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+void check(bool ok, char const* what, int line) {
+  if (!ok) {
+    std::fprintf(stderr, "check.cpp:%d: check failed: %s\n", line, what);
+    failures++;
+  }
+}
+
+using vec = socow_vector<std::string, 3>;
+
+vec numbers(int n) {
+  vec v;
+  for (int i = 0; i < n; i++) {
+    v.push_back(std::to_string(i));
+  }
+  return v;
+}
+
+// v holds "0", "1", ..., n - 1, read without unsharing
+bool holds(vec const& v, int n) {
+  if (v.size() != static_cast<size_t>(n)) {
+    return false;
+  }
+  for (int i = 0; i < n; i++) {
+    if (v[i] != std::to_string(i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool shared(vec const& a, vec const& b) {
+  return a.data() == b.data();
+}
+
+uint64_t unshares() {
+  return vec::stats::snapshot().unshares;
+}
+
+void check_sharing() {
+  vec a = numbers(10);
+  vec b(a);
+  CHECK(shared(a, b));
+  vec c;
+  c = a;
+  CHECK(shared(a, c));
+
+  // const access never unshares
+  vec::stats::reset();
+  CHECK(std::as_const(b)[9] == "9" && std::as_const(b).begin() != nullptr);
+  CHECK(unshares() == 0);
+
+  b[0] = "x";
+  CHECK(!shared(a, b) && shared(a, c));
+  CHECK(unshares() == 1);
+  CHECK(holds(a, 10) && b[0] == "x");
+
+  // small vectors are copied outright
+  vec s = numbers(2);
+  vec t(s);
+  CHECK(!shared(s, t));
+  t[0] = "x";
+  CHECK(holds(s, 2));
+}
+
+void check_bulk() {
+  vec a = numbers(10);
+  {
+    // an empty erase changes nothing and keeps the buffer shared
+    vec b(a);
+    vec::stats::reset();
+    b.erase(std::as_const(b).begin() + 4, std::as_const(b).begin() + 4);
+    CHECK(shared(a, b) && unshares() == 0);
+    b.resize(10);
+    CHECK(shared(a, b) && unshares() == 0);
+  }
+  {
+    // erasing from a shared buffer copies only the survivors, once
+    vec b(a);
+    vec::stats::reset();
+    b.erase(std::as_const(b).begin() + 2, std::as_const(b).begin() + 8);
+    CHECK(unshares() == 1);
+    CHECK(holds(a, 10));
+    CHECK(b.size() == 4 && b[1] == "1" && b[2] == "8" && b[3] == "9");
+  }
+  {
+    vec b(a);
+    b.insert(std::as_const(b).begin() + 5, 3, std::string("x"));
+    CHECK(holds(a, 10));
+    CHECK(b.size() == 13 && b[4] == "4" && b[7] == "x" && b[8] == "5");
+  }
+  {
+    vec b(a);
+    b.assign(4, std::string("y"));
+    CHECK(holds(a, 10));
+    CHECK(b.size() == 4 && b[3] == "y");
+  }
+  {
+    vec b(a);
+    b.resize(12, std::string("z"));
+    CHECK(holds(a, 10));
+    CHECK(b.size() == 12 && b[9] == "9" && b[11] == "z");
+  }
+  {
+    vec b(a);
+    vec::stats::reset();
+    std::span<std::string> span = b.mutable_span();
+    for (std::string& s : span) {
+      s += "!";
+    }
+    CHECK(unshares() == 1);
+    CHECK(holds(a, 10) && b[9] == "9!");
+  }
+  {
+    vec b(a);
+    b.clear();
+    CHECK(holds(a, 10) && b.empty());
+  }
+}
+
+// The flag lives in the top bit of the size word, so the object is one
+// word plus the inline buffer.
+static_assert(sizeof(socow_vector<int, 2>) == sizeof(size_t) + 2 * sizeof(int));
+static_assert(sizeof(socow_vector<char, 8>) == 2 * sizeof(size_t));
+static_assert(sizeof(compact_socow_vector<int>) == 64);
+static_assert(sizeof(compact_socow_vector<double, 128>) == 128);
+static_assert(sizeof(compact_socow_vector<std::string>) <= 64);
+
+void check_layout() {
+  // size and flag stay apart through every switch between inline and
+  // dynamic storage
+  vec a = numbers(2);
+  vec b = numbers(7);
+  CHECK(a.capacity() == 3 && b.capacity() >= 7);
+  a.swap(b);
+  CHECK(holds(a, 7) && holds(b, 2));
+  CHECK(a.capacity() >= 7 && b.capacity() == 3);
+  a.erase(std::as_const(a).begin() + 3, std::as_const(a).end());
+  a.shrink_to_fit();
+  CHECK(holds(a, 3) && a.capacity() == 3);
+  b = std::move(a);
+  CHECK(holds(b, 3));
+  vec c = numbers(5);
+  c.pop_back();
+  c.pop_back();
+  c.shrink_to_fit();
+  CHECK(holds(c, 3) && c.capacity() == 3);
+  c.push_back("3");
+  CHECK(holds(c, 4) && c.capacity() > 3);
+}
+
+// Four elements per chunk, so a few dozen elements span many chunks.
+using pvec = persistent_vector<std::string, 2, single_threaded_refcount, 4>;
+
+pvec pnumbers(int n) {
+  pvec v;
+  for (int i = 0; i < n; i++) {
+    v.push_back(std::to_string(i));
+  }
+  return v;
+}
+
+bool same(pvec const& v, std::vector<std::string> const& model) {
+  if (v.size() != model.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < model.size(); i++) {
+    if (v[i] != model[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Elements [first, last) of a and b live in the same chunks.
+bool shares(pvec const& a, pvec const& b, size_t first, size_t last) {
+  for (size_t i = first; i < last; i++) {
+    if (&a[i] != &b[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool shares_none(pvec const& a, pvec const& b, size_t first, size_t last) {
+  for (size_t i = first; i < last; i++) {
+    if (&a[i] == &b[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+uint64_t punshares() {
+  return pvec::stats::snapshot().unshares;
+}
+
+void check_chunk_sharing() {
+  pvec a = pnumbers(32);
+  std::vector<std::string> model(32);
+  for (int i = 0; i < 32; i++) {
+    model[i] = std::to_string(i);
+  }
+  {
+    pvec b(a);
+    CHECK(shares(a, b, 0, 32));
+    // one write copies the directory and the written chunk only
+    pvec::stats::reset();
+    b[5] = "x";
+    CHECK(punshares() == 2);
+    CHECK(shares(a, b, 0, 4) && shares_none(a, b, 4, 8) && shares(a, b, 8, 32));
+    CHECK(same(a, model) && b[5] == "x");
+  }
+  {
+    // erase and insert rewrite the chunks from the position on, each once
+    pvec b(a);
+    pvec::stats::reset();
+    b.erase(b.begin() + 9, b.begin() + 12);
+    CHECK(punshares() == 1 + 6);
+    CHECK(shares(a, b, 0, 8) && b.size() == 29 && b[9] == "12");
+    pvec c(a);
+    c.insert(c.begin() + 17, 3, std::string("y"));
+    CHECK(shares(a, c, 0, 16) && c.size() == 35 && c[17] == "y" && c[20] == "17");
+    CHECK(same(a, model));
+    // dropping whole chunks copies none of them
+    pvec d(a);
+    pvec::stats::reset();
+    d.resize(16);
+    CHECK(punshares() == 1 && shares(a, d, 0, 16));
+    d.resize(14);
+    CHECK(punshares() == 2 && shares(a, d, 0, 12) && d.size() == 14);
+  }
+  {
+    pvec b(a);
+    pvec::stats::reset();
+    size_t spans = 0;
+    b.mutable_spans([&](std::span<std::string> span) {
+      spans++;
+      for (std::string& s : span) {
+        s += "!";
+      }
+    });
+    CHECK(spans == 8 && punshares() == 1 + 8);
+    CHECK(b[31] == "31!" && same(a, model));
+  }
+  {
+    // swapping two trees swaps the directories, not the elements
+    pvec b = pnumbers(20);
+    pvec c(a);
+    std::string const* first = &std::as_const(b)[0];
+    b.swap(c);
+    CHECK(shares(a, b, 0, 32) && &std::as_const(c)[0] == first && c.size() == 20);
+    pvec small = pnumbers(2);
+    small.swap(c);
+    CHECK(small.size() == 20 && c.size() == 2 && c[1] == "1");
+  }
+}
+
+// Random operations against std::vector, with snapshots that must not
+// change while the original is modified.
+void check_persistent_model() {
+  std::mt19937 rng(7);
+  pvec v;
+  std::vector<std::string> model;
+  std::vector<std::pair<pvec, std::vector<std::string>>> snapshots;
+  auto pick = [&](size_t n) { return std::uniform_int_distribution<size_t>(0, n)(rng); };
+  for (int step = 0; step < 3000; step++) {
+    std::string value = std::to_string(step);
+    size_t pos = pick(model.size());
+    switch (pick(9)) {
+    case 0:
+    case 1:
+      v.push_back(value);
+      model.push_back(value);
+      break;
+    case 2:
+      if (!model.empty()) {
+        v.pop_back();
+        model.pop_back();
+      }
+      break;
+    case 3:
+      v.insert(v.begin() + pos, value);
+      model.insert(model.begin() + pos, value);
+      break;
+    case 4: {
+      size_t n = pick(9);
+      v.insert(v.begin() + pos, n, value);
+      model.insert(model.begin() + pos, n, value);
+      break;
+    }
+    case 5: {
+      std::list<std::string> range(pick(6), value);
+      v.insert(v.begin() + pos, range.begin(), range.end());
+      model.insert(model.begin() + pos, range.begin(), range.end());
+      break;
+    }
+    case 6: {
+      size_t n = pick(std::min<size_t>(model.size() - pos, 10));
+      v.erase(v.begin() + pos, v.begin() + pos + n);
+      model.erase(model.begin() + pos, model.begin() + pos + n);
+      break;
+    }
+    case 7: {
+      size_t n = pick(model.size() + 8);
+      v.resize(n, value);
+      model.resize(n, value);
+      break;
+    }
+    case 8:
+      if (pick(20) == 0) {
+        std::vector<std::string> other(pick(12), value);
+        v.assign(other.begin(), other.end());
+        model = other;
+      } else {
+        std::vector<std::string> range(pick(3), value);
+        v.append_range(range);
+        model.insert(model.end(), range.begin(), range.end());
+      }
+      break;
+    default:
+      snapshots.emplace_back(v, model);
+      break;
+    }
+    if (!same(v, model)) {
+      CHECK(same(v, model));
+      return;
+    }
+  }
+  for (auto const& [snapshot, expected] : snapshots) {
+    CHECK(same(snapshot, expected));
+  }
+}
+
+} // namespace
+
+int main() {
+  check_sharing();
+  check_bulk();
+  check_layout();
+  check_chunk_sharing();
+  check_persistent_model();
+  if (failures != 0) {
+    std::fprintf(stderr, "%d checks failed\n", failures);
+    return -1;
+  }
+  std::printf("all checks passed\n");
+  return 0;
+}
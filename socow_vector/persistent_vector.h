@@ -0,0 +1,801 @@
+#pragma once
+#include "socow_vector.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <iterator>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <utility>
+
+// Copy-on-write vector for large, widely shared contents. Up to SMALL_SIZE
+// elements are stored inline like in socow_vector; larger contents live in
+// a two-level tree: a refcounted directory of refcounted chunks of
+// ChunkSize elements. Copies share the whole tree, and a write copies only
+// the directory and the chunk it touches, so patching a few slots of a
+// shared vector costs O(N / ChunkSize + ChunkSize) instead of O(N).
+// Elements are not contiguous, so there is no data(), and mutable_span()
+// becomes mutable_spans(), which visits the elements chunk by chunk.
+//
+// Insertion in the middle gives only the basic guarantee: it shifts the
+// tail in place, so if copying or moving an element throws part-way, the
+// vector holds all of its elements' values but possibly in shifted
+// positions or with some of them moved from. Copies taken before are never
+// affected, as the chunks are unshared before anything is shifted.
+// Appending gives the strong guarantee.
+template <typename T, size_t SMALL_SIZE,
+          typename RefCount = single_threaded_refcount,
+          size_t ChunkSize =
+              std::bit_ceil(std::max<size_t>(SMALL_SIZE + 1, 4096 / sizeof(T)))>
+struct persistent_vector {
+  static_assert(std::has_single_bit(ChunkSize), "ChunkSize must be a power of two");
+  static_assert(SMALL_SIZE < ChunkSize, "inline elements must fit in one chunk");
+
+private:
+  template <typename It>
+  using iterator_category_t = typename std::iterator_traits<It>::iterator_category;
+
+  template <bool Const>
+  struct basic_iterator {
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = std::conditional_t<Const, T const*, T*>;
+    using reference = std::conditional_t<Const, T const&, T&>;
+    using container = std::conditional_t<Const, persistent_vector const, persistent_vector>;
+
+    basic_iterator() = default;
+
+    operator basic_iterator<true>() const {
+      return {vec_, pos_};
+    }
+
+    // writing through a mutable iterator unshares only the element's chunk
+    reference operator*() const {
+      return (*vec_)[pos_];
+    }
+    pointer operator->() const {
+      return &**this;
+    }
+    reference operator[](difference_type n) const {
+      return *(*this + n);
+    }
+
+    basic_iterator& operator++() {
+      ++pos_;
+      return *this;
+    }
+    basic_iterator operator++(int) {
+      basic_iterator res = *this;
+      ++pos_;
+      return res;
+    }
+    basic_iterator& operator--() {
+      --pos_;
+      return *this;
+    }
+    basic_iterator operator--(int) {
+      basic_iterator res = *this;
+      --pos_;
+      return res;
+    }
+    basic_iterator& operator+=(difference_type n) {
+      pos_ += n;
+      return *this;
+    }
+    basic_iterator& operator-=(difference_type n) {
+      pos_ -= n;
+      return *this;
+    }
+
+    friend basic_iterator operator+(basic_iterator it, difference_type n) {
+      return it += n;
+    }
+    friend basic_iterator operator+(difference_type n, basic_iterator it) {
+      return it += n;
+    }
+    friend basic_iterator operator-(basic_iterator it, difference_type n) {
+      return it -= n;
+    }
+    friend difference_type operator-(basic_iterator const& a, basic_iterator const& b) {
+      return static_cast<difference_type>(a.pos_) - static_cast<difference_type>(b.pos_);
+    }
+    friend bool operator==(basic_iterator const& a, basic_iterator const& b) {
+      return a.pos_ == b.pos_;
+    }
+    friend auto operator<=>(basic_iterator const& a, basic_iterator const& b) {
+      return a.pos_ <=> b.pos_;
+    }
+
+  private:
+    friend persistent_vector;
+    template <bool>
+    friend struct basic_iterator;
+
+    basic_iterator(container* vec, size_t pos) : vec_(vec), pos_(pos) {}
+
+    container* vec_ = nullptr;
+    size_t pos_ = 0;
+  };
+
+public:
+  using iterator = basic_iterator<false>;
+  using const_iterator = basic_iterator<true>;
+  using stats = container_stats<persistent_vector>;
+
+  static constexpr size_t chunk_size = ChunkSize;
+
+  persistent_vector() : size_(0), is_dynamic(false) {}
+
+  persistent_vector(persistent_vector const& other)
+      : size_(other.size_), is_dynamic(other.is_dynamic) {
+    if (is_dynamic) {
+      dir_ = other.dir_;
+      dir_->count_.acquire();
+    } else {
+      construct_from(other.data_.data(), other.data_.data() + size_, data_.data());
+    }
+  }
+
+  persistent_vector(persistent_vector&& other) noexcept(nothrow_move)
+      : size_(0), is_dynamic(false) {
+    steal(other);
+  }
+
+  persistent_vector& operator=(persistent_vector const& other) {
+    if (this != &other) {
+      persistent_vector tmp(other);
+      *this = std::move(tmp);
+    }
+    return *this;
+  }
+
+  persistent_vector& operator=(persistent_vector&& other) noexcept(nothrow_move) {
+    if (this != &other) {
+      clear();
+      steal(other);
+    }
+    return *this;
+  }
+
+  ~persistent_vector() {
+    clear();
+  }
+
+  T& operator[](size_t i) {
+    if (!is_dynamic) {
+      // through the pointer: i < size_ <= SMALL_SIZE here, which the
+      // compiler cannot see when it checks array bounds after inlining
+      return data_.data()[i];
+    }
+    return writable_chunk(i / ChunkSize)->data_[i % ChunkSize];
+  }
+  T const& operator[](size_t i) const {
+    if (!is_dynamic) {
+      return data_.data()[i];
+    }
+    return dir_->chunks_[i / ChunkSize]->data_[i % ChunkSize];
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  size_t capacity() const {
+    return is_dynamic ? dir_->slots_ * ChunkSize : SMALL_SIZE;
+  }
+
+  T& front() {
+    return (*this)[0];
+  }
+  T const& front() const {
+    return (*this)[0];
+  }
+
+  T& back() {
+    return (*this)[size_ - 1];
+  }
+  T const& back() const {
+    return (*this)[size_ - 1];
+  }
+
+  void push_back(T const& element) {
+    emplace_back(element);
+  }
+
+  void push_back(T&& element) {
+    emplace_back(std::move(element));
+  }
+
+  // Elements never move once in the tree, so args may refer to *this.
+  template <typename... Args>
+  T& emplace_back(Args&&... args) {
+    if (!is_dynamic) {
+      if (size_ < SMALL_SIZE) {
+        new (data_.data() + size_) T(std::forward<Args>(args)...);
+        return data_[size_++];
+      }
+      spill<true>(2, std::forward<Args>(args)...);
+      return dir_->chunks_[0]->data_[size_ - 1];
+    }
+    size_t k = size_ / ChunkSize;
+    size_t offset = size_ % ChunkSize;
+    chunk* c;
+    if (offset == 0) {
+      if (k == dir_->slots_) {
+        reshape_directory(std::max<size_t>(1, k * 2));
+      } else {
+        unshare_directory();
+      }
+      c = allocate_chunk();
+      try {
+        new (c->data_) T(std::forward<Args>(args)...);
+      } catch (...) {
+        free_chunk(c);
+        throw;
+      }
+      dir_->chunks_[k] = c;
+    } else {
+      c = writable_chunk(k);
+      new (c->data_ + offset) T(std::forward<Args>(args)...);
+    }
+    size_++;
+    return c->data_[offset];
+  }
+
+  void pop_back() {
+    if (!is_dynamic) {
+      data_[--size_].~T();
+      return;
+    }
+    size_t k = (size_ - 1) / ChunkSize;
+    size_t offset = (size_ - 1) % ChunkSize;
+    if (offset == 0) {
+      unshare_directory();
+      release_chunk(dir_->chunks_[k], 1);
+    } else {
+      writable_chunk(k)->data_[offset].~T();
+    }
+    size_--;
+  }
+
+  void clear() {
+    if (is_dynamic) {
+      release_tree(dir_, size_);
+      is_dynamic = false;
+    } else {
+      clean_up(data_.data(), size_);
+    }
+    size_ = 0;
+  }
+
+  iterator begin() {
+    return {this, 0};
+  }
+  iterator end() {
+    return {this, size_};
+  }
+
+  const_iterator begin() const {
+    return {this, 0};
+  }
+  const_iterator end() const {
+    return {this, size_};
+  }
+
+  iterator insert(const_iterator pos, T const& element) {
+    return insert(pos, 1, element);
+  }
+
+  iterator insert(const_iterator pos, T&& element) {
+    return insert_n(pos.pos_, 1, [&element](size_t) -> T&& { return std::move(element); });
+  }
+
+  iterator insert(const_iterator pos, size_t n, T const& element) {
+    // element may be one of ours, which the insertion moves
+    T copy(element);
+    return insert_n(pos.pos_, n, [&copy](size_t) -> T const& { return copy; });
+  }
+
+  // The range must not point into *this.
+  template <typename It, typename = iterator_category_t<It>>
+  iterator insert(const_iterator pos, It first, It last) {
+    if constexpr (std::is_base_of_v<std::random_access_iterator_tag, iterator_category_t<It>>) {
+      return insert_n(pos.pos_, last - first, [first](size_t j) -> decltype(auto) {
+        return first[static_cast<typename std::iterator_traits<It>::difference_type>(j)];
+      });
+    } else if (pos.pos_ == size_) {
+      for (; first != last; ++first) {
+        emplace_back(*first);
+      }
+      return {this, pos.pos_};
+    } else {
+      persistent_vector tmp;
+      tmp.insert(tmp.end(), first, last);
+      return insert_n(pos.pos_, tmp.size_,
+                      [&tmp](size_t j) -> T&& { return std::move(*tmp.slot(j)); });
+    }
+  }
+
+  iterator erase(const_iterator pos) {
+    return erase(pos, pos + 1);
+  }
+
+  // Copies only the chunks from `first` to the end, each once, and shifts
+  // the tail down one contiguous run at a time.
+  iterator erase(const_iterator first, const_iterator last) {
+    size_t beg = first.pos_;
+    size_t len = last - first;
+    if (len != 0) {
+      // a suffix only needs truncating, which copies at most one chunk
+      if (beg + len < size_) {
+        unshare_tail(beg);
+        move_down(beg + len, beg, size_ - beg - len);
+      }
+      truncate(size_ - len);
+    }
+    return {this, beg};
+  }
+
+  // O(1) when both are trees; otherwise moves the inline elements.
+  void swap(persistent_vector& other) {
+    if (is_dynamic && other.is_dynamic) {
+      std::swap(dir_, other.dir_);
+      std::swap(size_, other.size_);
+      return;
+    }
+    persistent_vector tmp(std::move(other));
+    other = std::move(*this);
+    *this = std::move(tmp);
+  }
+
+  void resize(size_t new_size) {
+    if (new_size <= size_) {
+      erase(begin() + new_size, end());
+    } else {
+      append_n(new_size - size_, [](size_t) { return T(); });
+    }
+  }
+
+  void resize(size_t new_size, T const& value) {
+    if (new_size <= size_) {
+      erase(begin() + new_size, end());
+    } else {
+      insert(end(), new_size - size_, value);
+    }
+  }
+
+  void assign(size_t n, T const& value) {
+    persistent_vector tmp;
+    tmp.append_n(n, [&value](size_t) -> T const& { return value; });
+    *this = std::move(tmp);
+  }
+
+  template <typename It, typename = iterator_category_t<It>>
+  void assign(It first, It last) {
+    persistent_vector tmp;
+    tmp.insert(tmp.end(), first, last);
+    *this = std::move(tmp);
+  }
+
+  template <typename Range>
+  void append_range(Range&& range) {
+    insert(end(), std::begin(range), std::end(range));
+  }
+
+  // Calls f(std::span<T>) for the elements of each chunk in order,
+  // unsharing every chunk once, for loops that would otherwise pay for the
+  // check on every operator[].
+  template <typename F>
+  void mutable_spans(F f) {
+    if (!is_dynamic) {
+      f(std::span<T>(data_.data(), size_));
+      return;
+    }
+    unshare_directory();
+    for (size_t k = 0; k < chunks_for(size_); k++) {
+      f(std::span<T>(unshare_chunk(k)->data_, chunk_length(k, size_)));
+    }
+  }
+
+  void reserve(size_t new_cap) {
+    if (new_cap <= capacity()) {
+      return;
+    }
+    if (is_dynamic) {
+      reshape_directory(chunks_for(new_cap));
+    } else {
+      spill<false>(chunks_for(new_cap));
+    }
+  }
+
+  void shrink_to_fit() {
+    if (!is_dynamic) {
+      return;
+    }
+    if (size_ <= SMALL_SIZE) {
+      become_small();
+    } else if (chunks_for(size_) < dir_->slots_) {
+      reshape_directory(chunks_for(size_));
+    }
+  }
+
+private:
+  static constexpr bool nothrow_move = std::is_nothrow_move_constructible_v<T>;
+
+  struct chunk {
+    RefCount count_;
+    T data_[0];
+  };
+
+  struct directory {
+    RefCount count_;
+    size_t slots_;
+    chunk* chunks_[0];
+
+    explicit directory(size_t slots_) : slots_(slots_) {}
+  };
+
+  size_t size_;
+  bool is_dynamic;
+
+  union {
+    std::array<T, SMALL_SIZE> data_;
+    directory* dir_;
+  };
+
+  static size_t chunks_for(size_t sz) {
+    return (sz + ChunkSize - 1) / ChunkSize;
+  }
+
+  static size_t chunk_length(size_t k, size_t sz) {
+    return std::min(ChunkSize, sz - k * ChunkSize);
+  }
+
+  static void clean_up(T* from, size_t sz) {
+    for (; sz > 0; sz--) {
+      from[sz - 1].~T();
+    }
+  }
+
+  template <typename It>
+  static void construct_from(It first, It last, T* to) {
+    size_t i = 0;
+    try {
+      for (; first != last; ++first, ++i) {
+        new (to + i) T(*first);
+      }
+    } catch (...) {
+      clean_up(to, i);
+      throw;
+    }
+  }
+
+  // Copies, or moves if that cannot throw, sz elements into raw memory.
+  static void relocate(T* from, size_t sz, T* to) {
+    if constexpr (nothrow_move) {
+      construct_from(std::make_move_iterator(from), std::make_move_iterator(from + sz), to);
+    } else {
+      construct_from(from, from + sz, to);
+    }
+  }
+
+  static chunk* allocate_chunk() {
+    size_t bytes = sizeof(chunk) + ChunkSize * sizeof(T);
+    chunk* c = new (static_cast<chunk*>(operator new(bytes))) chunk();
+    stats::on_allocation(bytes);
+    return c;
+  }
+
+  static void free_chunk(chunk* c) {
+    c->~chunk();
+    operator delete(c);
+  }
+
+  static void release_chunk(chunk* c, size_t len) {
+    if (c->count_.release()) {
+      clean_up(c->data_, len);
+      free_chunk(c);
+    }
+  }
+
+  static directory* allocate_directory(size_t slots) {
+    size_t bytes = sizeof(directory) + slots * sizeof(chunk*);
+    directory* d = new (static_cast<directory*>(operator new(bytes))) directory(slots);
+    stats::on_allocation(bytes);
+    return d;
+  }
+
+  static void free_directory(directory* d) {
+    d->~directory();
+    operator delete(d);
+  }
+
+  static void release_tree(directory* d, size_t sz) {
+    if (d->count_.release()) {
+      for (size_t k = 0; k < chunks_for(sz); k++) {
+        release_chunk(d->chunks_[k], chunk_length(k, sz));
+      }
+      free_directory(d);
+    }
+  }
+
+  // Replaces the directory by an unshared one with the given number of
+  // slots. The chunks stay shared with other owners of the old directory.
+  void reshape_directory(size_t slots) {
+    directory* d = allocate_directory(slots);
+    size_t n = chunks_for(size_);
+    bool shared = dir_->count_.is_shared();
+    for (size_t k = 0; k < n; k++) {
+      d->chunks_[k] = dir_->chunks_[k];
+      if (shared) {
+        d->chunks_[k]->count_.acquire();
+      }
+    }
+    if (shared) {
+      release_tree(dir_, size_);
+    } else {
+      free_directory(dir_);
+    }
+    dir_ = d;
+  }
+
+  void unshare_directory() {
+    if (dir_->count_.is_shared()) {
+      stats::on_unshare(dir_->slots_ * sizeof(chunk*));
+      reshape_directory(dir_->slots_);
+    }
+  }
+
+  chunk* writable_chunk(size_t k) {
+    unshare_directory();
+    return unshare_chunk(k);
+  }
+
+  // The directory must not be shared.
+  chunk* unshare_chunk(size_t k) {
+    chunk*& c = dir_->chunks_[k];
+    if (c->count_.is_shared()) {
+      size_t len = chunk_length(k, size_);
+      stats::on_unshare(len * sizeof(T));
+      chunk* copy = allocate_chunk();
+      try {
+        construct_from(c->data_, c->data_ + len, copy->data_);
+      } catch (...) {
+        free_chunk(copy);
+        throw;
+      }
+      release_chunk(c, len);
+      c = copy;
+    }
+    return c;
+  }
+
+  // Moves the inline elements into a new tree with the given number of
+  // directory slots; with Append, also appends T(args...).
+  template <bool Append, typename... Args>
+  void spill(size_t slots, Args&&... args) {
+    directory* d = allocate_directory(slots);
+    size_t sz = size_ + (Append ? 1 : 0);
+    if (sz != 0) {
+      chunk* c;
+      try {
+        c = allocate_chunk();
+      } catch (...) {
+        free_directory(d);
+        throw;
+      }
+      try {
+        if constexpr (Append) {
+          new (c->data_ + size_) T(std::forward<Args>(args)...);
+        }
+        try {
+          relocate(data_.data(), size_, c->data_);
+        } catch (...) {
+          if constexpr (Append) {
+            c->data_[size_].~T();
+          }
+          throw;
+        }
+      } catch (...) {
+        free_chunk(c);
+        free_directory(d);
+        throw;
+      }
+      d->chunks_[0] = c;
+    }
+    clean_up(data_.data(), size_);
+    dir_ = d;
+    is_dynamic = true;
+    size_ = sz;
+  }
+
+  void become_small() {
+    directory* d = dir_;
+    T* from = size_ != 0 ? d->chunks_[0]->data_ : nullptr;
+    bool exclusive = !d->count_.is_shared() && (size_ == 0 || !d->chunks_[0]->count_.is_shared());
+    try {
+      if (exclusive) {
+        relocate(from, size_, data_.data());
+      } else {
+        construct_from(from, from + size_, data_.data());
+      }
+    } catch (...) {
+      dir_ = d;
+      throw;
+    }
+    release_tree(d, size_);
+    is_dynamic = false;
+  }
+
+  // Takes the contents of other, which is left empty; *this must be empty
+  // and small.
+  void steal(persistent_vector& other) noexcept(nothrow_move) {
+    if (other.is_dynamic) {
+      dir_ = other.dir_;
+      is_dynamic = true;
+      other.is_dynamic = false;
+    } else {
+      T* from = other.data_.data();
+      construct_from(std::make_move_iterator(from), std::make_move_iterator(from + other.size_),
+                     data_.data());
+      clean_up(from, other.size_);
+    }
+    size_ = other.size_;
+    other.size_ = 0;
+  }
+
+  // Element i, without unsharing anything.
+  T* slot(size_t i) {
+    return is_dynamic ? dir_->chunks_[i / ChunkSize]->data_ + i % ChunkSize : data_.data() + i;
+  }
+
+  // Number of slots in the storage run (the chunk, or the inline buffer)
+  // that ends at slot end - 1.
+  size_t run_before(size_t end) const {
+    return is_dynamic ? (end - 1) % ChunkSize + 1 : end;
+  }
+
+  // Number of slots in the storage run that starts at slot i.
+  size_t run_after(size_t i) const {
+    return is_dynamic ? ChunkSize - i % ChunkSize : SMALL_SIZE - i;
+  }
+
+  // Destroys the elements from new_size on. Chunks left empty are
+  // released without being copied; only a partly kept chunk is unshared.
+  void truncate(size_t new_size) {
+    if (!is_dynamic) {
+      clean_up(data_.data() + new_size, size_ - new_size);
+      size_ = new_size;
+      return;
+    }
+    unshare_directory();
+    size_t k = new_size / ChunkSize;
+    size_t offset = new_size % ChunkSize;
+    if (offset != 0) {
+      chunk* c = unshare_chunk(k);
+      clean_up(c->data_ + offset, chunk_length(k, size_) - offset);
+      k++;
+    }
+    for (; k < chunks_for(size_); k++) {
+      release_chunk(dir_->chunks_[k], chunk_length(k, size_));
+    }
+    size_ = new_size;
+  }
+
+  // Unshares the directory and, once each, the chunks holding elements
+  // from pos on, so that those can be rewritten in place.
+  void unshare_tail(size_t pos) {
+    if (is_dynamic) {
+      unshare_directory();
+      for (size_t k = pos / ChunkSize; k < chunks_for(size_); k++) {
+        unshare_chunk(k);
+      }
+    }
+  }
+
+  // Move-assigns the n elements from `from` to the n slots from to < from,
+  // front to back, one contiguous run at a time. The slots must be
+  // writable.
+  void move_down(size_t from, size_t to, size_t n) {
+    while (n != 0) {
+      size_t len = std::min({n, run_after(from), run_after(to)});
+      T* src = slot(from);
+      std::move(src, src + len, slot(to));
+      from += len;
+      to += len;
+      n -= len;
+    }
+  }
+
+  // Move-assigns the n elements from `from` to the n slots from to > from,
+  // back to front, one contiguous run at a time. The slots must be
+  // writable.
+  void move_up(size_t from, size_t to, size_t n) {
+    while (n != 0) {
+      size_t len = std::min({n, run_before(from + n), run_before(to + n)});
+      T* src = slot(from + n - len);
+      std::move_backward(src, src + len, slot(to + n - len) + len);
+      n -= len;
+    }
+  }
+
+  // Appends n elements, the j-th built from value(j). Unshares the last
+  // chunk once and fills each chunk in one pass.
+  template <typename Value>
+  void append_n(size_t n, Value value) {
+    if (size_ + n > capacity()) {
+      reserve(std::max(size_ + n, capacity() * 2));
+    }
+    if (!is_dynamic) {
+      for (size_t j = 0; j < n; j++) {
+        new (data_.data() + size_) T(value(j));
+        size_++;
+      }
+      return;
+    }
+    unshare_directory();
+    for (size_t j = 0; j < n;) {
+      size_t k = size_ / ChunkSize;
+      size_t offset = size_ % ChunkSize;
+      chunk* c;
+      if (offset == 0) {
+        c = allocate_chunk();
+        try {
+          new (c->data_) T(value(j));
+        } catch (...) {
+          free_chunk(c);
+          throw;
+        }
+        dir_->chunks_[k] = c;
+        size_++;
+        j++;
+        offset++;
+      } else {
+        c = unshare_chunk(k);
+      }
+      for (; j < n && offset < ChunkSize; j++, offset++) {
+        new (c->data_ + offset) T(value(j));
+        size_++;
+      }
+    }
+  }
+
+  // Inserts n elements at pos, the j-th being value(j): the last elements
+  // are moved into new slots at the end, the rest of the tail is shifted
+  // up chunk by chunk, and the gap is assigned. Every touched chunk is
+  // unshared once, up front. Basic guarantee: see the comment on
+  // persistent_vector.
+  template <typename Value>
+  iterator insert_n(size_t pos, size_t n, Value value) {
+    if (n == 0) {
+      return {this, pos};
+    }
+    if (size_ + n > capacity()) {
+      reserve(std::max(size_ + n, capacity() * 2));
+    }
+    unshare_tail(pos);
+    size_t old = size_;
+    size_t tail = old - pos;
+    if (n <= tail) {
+      append_n(n, [this, old, n](size_t j) -> T&& { return std::move(*slot(old - n + j)); });
+      move_up(pos, pos + n, tail - n);
+      for (size_t j = 0; j < n; j++) {
+        *slot(pos + j) = value(j);
+      }
+    } else {
+      append_n(n - tail, [&value, tail](size_t j) -> decltype(auto) { return value(tail + j); });
+      append_n(tail, [this, pos](size_t j) -> T&& { return std::move(*slot(pos + j)); });
+      for (size_t j = 0; j < tail; j++) {
+        *slot(pos + j) = value(j);
+      }
+    }
+    return {this, pos};
+  }
+};
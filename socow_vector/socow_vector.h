@@ -1,24 +1,108 @@
 #pragma once
+#include "../telemetry/container_stats.h"
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <cassert>
 #include <cstddef>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <utility>
 
-template <typename T, size_t SMALL_SIZE>
+// Reference count policies for the shared buffer. The default one is for
+// vectors that never share a buffer across threads.
+struct single_threaded_refcount {
+  void acquire() {
+    count_++;
+  }
+
+  // returns true if the caller dropped the last reference
+  bool release() {
+    return --count_ == 0;
+  }
+
+  bool is_shared() const {
+    return count_ > 1;
+  }
+
+private:
+  size_t count_ = 1;
+};
+
+// Lets copies of one socow_vector be used from different threads. A copy
+// only needs a relaxed increment, since the copied-from vector already
+// holds a reference; the release decrement and the acquire load in
+// is_shared() make writes to the buffer by its previous owners visible
+// before it is mutated or destroyed.
+struct atomic_refcount {
+  void acquire() {
+    count_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  bool release() {
+    return count_.fetch_sub(1, std::memory_order_acq_rel) == 1;
+  }
+
+  bool is_shared() const {
+    return count_.load(std::memory_order_acquire) > 1;
+  }
+
+private:
+  std::atomic<size_t> count_{1};
+};
+
+// Number of inline elements that keeps a socow_vector<T, N> within
+// target_bytes, e.g. one cache line.
+template <typename T>
+constexpr size_t socow_inline_capacity(size_t target_bytes) {
+  size_t header = std::max(sizeof(size_t), alignof(T));
+  return target_bytes > header ? (target_bytes - header) / sizeof(T) : 0;
+}
+
+// Vector with SMALL_SIZE elements stored inline and a copy-on-write heap
+// buffer beyond that. Insertions give the strong guarantee. When moving T
+// may throw, an insertion into a small vector therefore moves it to the
+// heap even if the result would fit inline: rebuilding the inline buffer
+// in place could fail half-way, and two inline buffers cannot be swapped
+// without moving, and so possibly throwing.
+template <typename T, size_t SMALL_SIZE,
+          typename RefCount = single_threaded_refcount>
 struct socow_vector {
   using iterator = T*;
   using const_iterator = T const*;
+  using stats = container_stats<socow_vector>;
+
+private:
+  template <typename It>
+  using iterator_category_t = typename std::iterator_traits<It>::iterator_category;
 
+  template <typename It>
+  static constexpr bool is_forward_iterator =
+      std::is_base_of_v<std::forward_iterator_tag, iterator_category_t<It>>;
+
+public:
   socow_vector() : size_(0), is_dynamic(false) {}
 
   socow_vector(socow_vector const& other)
       : size_(other.size_), is_dynamic(other.is_dynamic) {
     if (other.is_dynamic) {
       d_data_ = other.d_data_;
-      d_data_->count_++;
+      d_data_->count_.acquire();
     } else {
       copy_elements(get_data(), other.data(), size_);
     }
   }
 
+  socow_vector(socow_vector&& other) noexcept(nothrow_move)
+      : size_(0), is_dynamic(false) {
+    steal(other);
+  }
+
   socow_vector& operator=(socow_vector const& other) {
     if (this != &other) {
       socow_vector(other).swap(*this);
@@ -26,7 +110,20 @@ struct socow_vector {
     return *this;
   }
 
+  socow_vector& operator=(socow_vector&& other) noexcept(nothrow_move) {
+    if (this != &other) {
+      clean_with_size_save();
+      size_ = 0;
+      is_dynamic = false;
+      steal(other);
+    }
+    return *this;
+  }
+
   ~socow_vector() {
+    if (is_dynamic) {
+      note_capacity();
+    }
     clean_with_size_save();
     size_ = 0;
   }
@@ -76,9 +173,10 @@ struct socow_vector {
   }
 
   void clear() {
-    if (is_dynamic && d_data_->count_ > 1) {
-      d_data_->count_--;
-      d_data_ = allocate_buffer(capacity());
+    if (is_dynamic && d_data_->count_.is_shared()) {
+      dynamic_data* tmp = allocate_buffer(capacity());
+      release_buffer(d_data_, size_);
+      d_data_ = tmp;
     } else {
       clean_up(get_data(), size_, 0);
     }
@@ -101,12 +199,45 @@ struct socow_vector {
   }
 
   iterator insert(const_iterator pos, T const& element) {
+    return insert(pos, 1, element);
+  }
+
+  iterator insert(const_iterator pos, T&& element) {
+    return insert_raw(pos - get_data(), 1,
+                      [&element](T* to) { new (to) T(std::move(element)); });
+  }
+
+  iterator insert(const_iterator pos, size_t n, T const& element) {
+    size_t insert_pos = pos - get_data();
+    T const* data = get_data();
+    if (std::less_equal<T const*>()(data, &element) &&
+        std::less<T const*>()(&element, data + size_)) {
+      T copy(element);
+      return insert_raw(insert_pos, n,
+                        [this, n, &copy](T* to) { construct_n(to, n, copy); });
+    }
+    return insert_raw(insert_pos, n,
+                      [this, n, &element](T* to) { construct_n(to, n, element); });
+  }
+
+  // The range must not point into *this.
+  template <typename It, typename = iterator_category_t<It>>
+  iterator insert(const_iterator pos, It first, It last) {
     size_t insert_pos = pos - get_data();
-    push_back(element);
-    for (size_t i = size() - 1; i != insert_pos; i--) {
-      std::swap((*this)[i], (*this)[i - 1]);
+    if constexpr (!is_forward_iterator<It>) {
+      socow_vector tmp;
+      for (; first != last; ++first) {
+        tmp.emplace_back(*first);
+      }
+      T* from = tmp.get_data();
+      return insert_raw(insert_pos, tmp.size(), [this, from, &tmp](T* to) {
+        construct_from(std::make_move_iterator(from),
+                       std::make_move_iterator(from + tmp.size()), to);
+      });
+    } else {
+      return insert_raw(insert_pos, std::distance(first, last),
+                        [this, first, last](T* to) { construct_from(first, last, to); });
     }
-    return begin() + insert_pos;
   }
 
   iterator erase(const_iterator pos) {
@@ -116,32 +247,152 @@ struct socow_vector {
   iterator erase(const_iterator first, T const* last) {
     size_t beg = first - get_data();
     size_t len = last - first;
-    for (size_t i = beg; i + len < size(); i++) {
-      std::swap((*this)[i], (*this)[i + len]);
+    if (len == 0) {
+      // nothing changes, so a shared buffer stays shared; the result only
+      // marks the position and must not be written through while shared
+      return get_data() + beg;
+    }
+    if (!owns_elements()) {
+      // copy only the survivors instead of unsharing everything
+      stats::on_unshare((size_ - len) * sizeof(T));
+      dynamic_data* tmp = allocate_buffer(capacity());
+      try {
+        copy_elements(tmp->data_, d_data_->data_, beg);
+        try {
+          copy_elements(tmp->data_ + beg, d_data_->data_ + beg + len,
+                        size_ - beg - len);
+        } catch (...) {
+          clean_up(tmp->data_, beg, 0);
+          throw;
+        }
+      } catch (...) {
+        free_buffer(tmp);
+        throw;
+      }
+      release_buffer(d_data_, size_);
+      d_data_ = tmp;
+    } else {
+      T* data = get_data();
+      if constexpr (std::is_trivially_copyable_v<T>) {
+        std::memmove(static_cast<void*>(data + beg), data + beg + len,
+                     sizeof(T) * (size_ - beg - len));
+      } else {
+        std::move(data + beg + len, data + size_, data + beg);
+        clean_up(data, size_, size_ - len);
+      }
     }
-    clean_up(get_data(), size_, size_ - len);
     size_ -= len;
-    return begin() + beg;
+    return get_data() + beg;
+  }
+
+  void resize(size_t new_size) {
+    if (new_size <= size_) {
+      erase(get_data() + new_size, get_data() + size_);
+    } else {
+      size_t n = new_size - size_;
+      insert_raw(size_, n, [this, n](T* to) { construct_n(to, n); });
+    }
+  }
+
+  void resize(size_t new_size, T const& value) {
+    if (new_size <= size_) {
+      erase(get_data() + new_size, get_data() + size_);
+    } else {
+      insert(get_data() + size_, new_size - size_, value);
+    }
+  }
+
+  void assign(size_t n, T const& value) {
+    if (n > capacity() || !owns_elements()) {
+      socow_vector tmp;
+      tmp.insert(tmp.get_data(), n, value);
+      *this = std::move(tmp);
+      return;
+    }
+    T* data = get_data();
+    std::fill_n(data, std::min(n, size_), value);
+    if (n > size_) {
+      construct_n(data + size_, n - size_, value);
+    } else {
+      clean_up(data, size_, n);
+    }
+    size_ = n;
+  }
+
+  template <typename It, typename = iterator_category_t<It>>
+  void assign(It first, It last) {
+    if constexpr (!is_forward_iterator<It>) {
+      socow_vector tmp;
+      tmp.insert(tmp.get_data(), first, last);
+      *this = std::move(tmp);
+    } else {
+      size_t n = std::distance(first, last);
+      if (n > capacity() || !owns_elements()) {
+        socow_vector tmp;
+        tmp.insert(tmp.get_data(), first, last);
+        *this = std::move(tmp);
+        return;
+      }
+      T* data = get_data();
+      size_t common = std::min(n, size_);
+      It mid = std::next(first, common);
+      std::copy(first, mid, data);
+      if (n > size_) {
+        construct_from(mid, last, data + size_);
+      } else {
+        clean_up(data, size_, n);
+      }
+      size_ = n;
+    }
+  }
+
+  template <typename Range>
+  void append_range(Range&& range) {
+    insert(get_data() + size_, std::begin(range), std::end(range));
+  }
+
+  // Unshares once, for loops that would otherwise pay for it on every
+  // operator[]. Valid until *this is copied or its capacity changes.
+  std::span<T> mutable_span() {
+    return {begin(), size_};
   }
 
   void push_back(T const& element) {
+    emplace_back(element);
+  }
+
+  void push_back(T&& element) {
+    emplace_back(std::move(element));
+  }
+
+  template <typename... Args>
+  T& emplace_back(Args&&... args) {
     if (size() == capacity()) {
-      dynamic_data* tmp = copy_wider(capacity() * 2);
+      note_growth();
+      dynamic_data* tmp = allocate_buffer(capacity() == 0 ? 1 : capacity() * 2);
+      // the new element goes first: args may refer to elements of *this
       try {
-        new (tmp->data_ + size_) T(element);
+        new (tmp->data_ + size_) T(std::forward<Args>(args)...);
       } catch (...) {
-        clean_up(tmp->data_, size_, 0);
-        operator delete(tmp);
+        free_buffer(tmp);
+        throw;
+      }
+      try {
+        transfer_elements(tmp->data_, size_);
+      } catch (...) {
+        tmp->data_[size_].~T();
+        free_buffer(tmp);
         throw;
       }
       clean_with_size_save();
       is_dynamic = true;
       d_data_ = tmp;
+      note_capacity();
     } else {
       unshare();
-      new (end()) T(element);
+      new (end()) T(std::forward<Args>(args)...);
     }
-    size_++;
+    return get_data()[size_++];
   }
 
   void swap(socow_vector& other) {
@@ -158,12 +409,17 @@ struct socow_vector {
     } else {
       big_small_swap(other, *this);
     }
-    std::swap(size_, other.size_);
-    std::swap(is_dynamic, other.is_dynamic);
+    size_t sz = size_;
+    size_ = other.size_;
+    other.size_ = sz;
+    bool dynamic = is_dynamic;
+    is_dynamic = other.is_dynamic;
+    other.is_dynamic = dynamic;
   }
 
   void reserve(size_t new_cap) {
     if (new_cap > capacity()) {
+      note_growth();
       copy_and_recapas(new_cap);
     }
     unshare();
@@ -180,15 +436,24 @@ struct socow_vector {
   }
 
 private:
-  size_t size_;
-  bool is_dynamic;
+  static constexpr bool nothrow_move = std::is_nothrow_move_constructible_v<T>;
+
+  // Buffers of arithmetic elements start on a cache line, so that
+  // vectorized loops over them need no peeling.
+  static constexpr size_t buffer_alignment =
+      std::is_arithmetic_v<T> ? std::max<size_t>(64, alignof(T)) : alignof(T);
+
+  // The flag shares a word with the size: the whole object is one word
+  // plus the inline buffer.
+  size_t size_ : std::numeric_limits<size_t>::digits - 1;
+  bool is_dynamic : 1;
 
   struct dynamic_data {
-    size_t count_;
+    RefCount count_;
     size_t capacity_;
-    T data_[0];
+    alignas(buffer_alignment) T data_[0];
 
-    explicit dynamic_data(size_t capacity_) : count_(1), capacity_(capacity_) {}
+    explicit dynamic_data(size_t capacity_) : capacity_(capacity_) {}
   };
 
   union {
@@ -209,41 +474,212 @@ private:
   }
 
   static dynamic_data* allocate_buffer(size_t capacity) {
-    dynamic_data* new_data = new (static_cast<dynamic_data*>(operator new(
-        sizeof(dynamic_data) + capacity * sizeof(T)))) dynamic_data(capacity);
+    dynamic_data* new_data = new (static_cast<dynamic_data*>(
+        operator new(sizeof(dynamic_data) + capacity * sizeof(T),
+                     std::align_val_t(alignof(dynamic_data))))) dynamic_data(capacity);
+    stats::on_allocation(sizeof(dynamic_data) + capacity * sizeof(T));
     return new_data;
   }
 
+  static void free_buffer(dynamic_data* data) {
+    operator delete(data, std::align_val_t(alignof(dynamic_data)));
+  }
+
+  void note_capacity() const {
+    stats::on_capacity(size_ * sizeof(T), capacity() * sizeof(T));
+  }
+
   void unshare() {
-    if (is_dynamic && d_data_->count_ > 1) {
+    if (is_dynamic && d_data_->count_.is_shared()) {
+      stats::on_unshare(size_ * sizeof(T));
       copy_and_recapas(capacity());
     }
   }
 
   void clean_with_size_save() {
     size_t prev_sz = size_;
-    if (!is_dynamic || --d_data_->count_ == 0) {
+    if (is_dynamic) {
+      release_buffer(d_data_, size_);
+    } else {
       clean_up(get_data(), size_, 0);
-      if (is_dynamic) {
-        d_data_->capacity_ = 0;
-        operator delete(d_data_);
-      }
     }
     size_ = prev_sz;
   }
 
+  void release_buffer(dynamic_data* data, size_t sz) {
+    if (data->count_.release()) {
+      clean_up(data->data_, sz, 0);
+      data->capacity_ = 0;
+      free_buffer(data);
+    }
+  }
+
   void clean_up(T* from, size_t sz, size_t last) {
     for (; sz > last; sz--) {
       (*(from + sz - 1)).~T();
     }
   }
 
+  // Elements may be moved out only if no other vector can see them.
+  bool owns_elements() const {
+    return !is_dynamic || !d_data_->count_.is_shared();
+  }
+
+  // Builds to[i] from element i for i in [beg, sz): copies, or moves if
+  // that cannot throw and the elements are not shared. On exception that
+  // part of `to` holds nothing.
+  void transfer_elements(T* to, size_t sz, size_t beg = 0) {
+    if (nothrow_move && owns_elements()) {
+      T* from = get_data();
+      if constexpr (std::is_trivially_copyable_v<T>) {
+        if (sz != beg) {
+          std::memcpy(static_cast<void*>(to + beg), from + beg, (sz - beg) * sizeof(T));
+        }
+      } else {
+        for (size_t i = beg; i < sz; i++) {
+          new (to + i) T(std::move(from[i]));
+        }
+      }
+    } else {
+      copy_elements(to, get_data(), sz, beg);
+    }
+  }
+
+  template <typename... Args>
+  void construct_n(T* to, size_t n, Args const&... args) {
+    size_t i = 0;
+    try {
+      for (; i < n; i++) {
+        new (to + i) T(args...);
+      }
+    } catch (...) {
+      clean_up(to, i, 0);
+      throw;
+    }
+  }
+
+  template <typename It>
+  void construct_from(It first, It last, T* to) {
+    size_t i = 0;
+    try {
+      for (; first != last; ++first, ++i) {
+        new (to + i) T(*first);
+      }
+    } catch (...) {
+      clean_up(to, i, 0);
+      throw;
+    }
+  }
+
+  // Moves sz elements between overlapping ranges of an unshared buffer,
+  // destroying the sources. Only used when moving cannot throw.
+  static void relocate_within(T* from, size_t sz, T* to) {
+    if constexpr (std::is_trivially_copyable_v<T>) {
+      if (sz != 0) {
+        std::memmove(static_cast<void*>(to), from, sizeof(T) * sz);
+      }
+    } else if (to > from) {
+      for (size_t i = sz; i > 0; i--) {
+        new (to + i - 1) T(std::move(from[i - 1]));
+        from[i - 1].~T();
+      }
+    } else {
+      for (size_t i = 0; i < sz; i++) {
+        new (to + i) T(std::move(from[i]));
+        from[i].~T();
+      }
+    }
+  }
+
+  // Opens a gap of n elements at pos and fills it with build(gap), which
+  // must build all n elements or none. Unshares, reallocates and shifts
+  // the tail at most once; *this is unchanged if build throws. Unless
+  // moves are nothrow, the result is built in a new heap buffer, also for
+  // a small vector: see the comment on socow_vector.
+  template <typename Build>
+  T* insert_raw(size_t pos, size_t n, Build build) {
+    if (n == 0) {
+      return begin() + pos;
+    }
+    if (size_ + n > capacity() || !owns_elements() || !nothrow_move) {
+      bool grow = size_ + n > capacity();
+      if (grow) {
+        note_growth();
+      } else if (!owns_elements()) {
+        stats::on_unshare(size_ * sizeof(T));
+      }
+      dynamic_data* tmp =
+          allocate_buffer(grow ? std::max(size_ + n, capacity() * 2) : capacity());
+      try {
+        build(tmp->data_ + pos);
+      } catch (...) {
+        free_buffer(tmp);
+        throw;
+      }
+      try {
+        transfer_elements(tmp->data_, pos);
+        try {
+          // to[i + n] is built from element i
+          transfer_elements(tmp->data_ + n, size_, pos);
+        } catch (...) {
+          clean_up(tmp->data_, pos, 0);
+          throw;
+        }
+      } catch (...) {
+        clean_up(tmp->data_ + pos, n, 0);
+        free_buffer(tmp);
+        throw;
+      }
+      clean_with_size_save();
+      is_dynamic = true;
+      d_data_ = tmp;
+      size_ += n;
+      note_capacity();
+      return tmp->data_ + pos;
+    }
+    T* data = get_data();
+    relocate_within(data + pos, size_ - pos, data + pos + n);
+    try {
+      build(data + pos);
+    } catch (...) {
+      relocate_within(data + pos + n, size_ - pos, data + pos);
+      throw;
+    }
+    size_ += n;
+    return data + pos;
+  }
+
+  void note_growth() const {
+    if (nothrow_move && owns_elements()) {
+      stats::on_growth(0, size_);
+    } else {
+      stats::on_growth(size_, 0);
+    }
+  }
+
+  // Takes the contents of other, which is left empty; *this must be empty
+  // and small.
+  void steal(socow_vector& other) noexcept(nothrow_move) {
+    if (other.is_dynamic) {
+      d_data_ = other.d_data_;
+      is_dynamic = true;
+      other.is_dynamic = false;
+    } else {
+      T* from = other.data_.data();
+      construct_from(std::make_move_iterator(from),
+                     std::make_move_iterator(from + other.size_), data_.data());
+      clean_up(from, other.size_, 0);
+    }
+    size_ = other.size_;
+    other.size_ = 0;
+  }
+
   dynamic_data* copy_wider(size_t cap) {
     dynamic_data* new_data = allocate_buffer(cap);
     try {
-      copy_elements(new_data->data_, get_data(), size());
+      transfer_elements(new_data->data_, size_);
     } catch (...) {
-      operator delete(new_data);
+      free_buffer(new_data);
       throw;
     }
     return new_data;
@@ -258,6 +694,7 @@ private:
     clean_with_size_save();
     d_data_ = tmp;
     is_dynamic = true;
+    note_capacity();
   }
 
   void become_small() {
@@ -265,16 +702,18 @@ private:
     dynamic_data* tmp = d_data_;
     d_data_ = nullptr;
     try {
-      copy_elements(data_.data(), tmp->data_, size_);
+      if (nothrow_move && !tmp->count_.is_shared()) {
+        for (size_t i = 0; i < size_; i++) {
+          new (data_.data() + i) T(std::move(tmp->data_[i]));
+        }
+      } else {
+        copy_elements(data_.data(), tmp->data_, size_);
+      }
     } catch (...) {
       d_data_ = tmp;
       throw;
     }
-    if (--tmp->count_ == 0) {
-      clean_up(tmp->data_, size_, 0);
-      tmp->capacity_ = 0;
-      operator delete(tmp);
-    }
+    release_buffer(tmp, size_);
     is_dynamic = false;
   }
 
@@ -300,3 +739,9 @@ private:
     }
   }
 };
+
+// socow_vector whose inline capacity is as large as fits in TargetBytes.
+template <typename T, size_t TargetBytes = 64,
+          typename RefCount = single_threaded_refcount>
+using compact_socow_vector =
+    socow_vector<T, socow_inline_capacity<T>(TargetBytes), RefCount>;
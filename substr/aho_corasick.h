@@ -0,0 +1,167 @@
+#pragma once
+#include "pattern.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <queue>
+#include <string>
+#include <vector>
+
+// Aho-Corasick automaton that finds which of a set of patterns occur in a
+// text, in one pass. Bytes that occur in no pattern share one class, so
+// the dense transition table has (distinct pattern bytes + 1) columns and
+// stays small enough for the cache even for hundreds of patterns. Patterns
+// may be of any length. With ignore_case both cases of a letter share a
+// class, which folds the case of the text for free.
+struct aho_corasick {
+  static constexpr uint32_t none = UINT32_MAX;
+
+  // Progress of one search; it carries over between consecutive pieces of
+  // the same text.
+  struct search_state {
+    explicit search_state(aho_corasick const& ac)
+        : done(ac.state_count(), 0), matched(ac.pattern_count(), 0) {}
+
+    uint32_t node = 0;
+    std::vector<char> done;
+    std::vector<char> matched;
+    size_t matched_count = 0;
+  };
+
+  explicit aho_corasick(std::vector<std::string> const& patterns, bool ignore_case = false)
+      : pattern_count_(patterns.size()), next_end_(patterns.size(), none) {
+    build_classes(patterns, ignore_case);
+    build_trie(patterns);
+    build_links();
+  }
+
+  size_t pattern_count() const {
+    return pattern_count_;
+  }
+
+  size_t state_count() const {
+    return first_end_.size();
+  }
+
+  // Marks the patterns found in text. Returns false once every pattern
+  // has been found, as further input cannot change the result.
+  bool scan(search_state& st, char const* text, size_t len) const {
+    if (st.node == 0 && has_output_[0] && !st.done[0]) {
+      report(st, 0);
+    }
+    uint32_t node = st.node;
+    for (size_t i = 0; i < len; i++) {
+      node = next_[node * classes_ + class_[static_cast<unsigned char>(text[i])]];
+      if (has_output_[node] && !st.done[node]) {
+        report(st, node);
+        if (st.matched_count == pattern_count_) {
+          st.node = node;
+          return false;
+        }
+      }
+    }
+    st.node = node;
+    return st.matched_count != pattern_count_;
+  }
+
+private:
+  size_t pattern_count_;
+  size_t classes_ = 1;
+  std::array<uint16_t, 256> class_{};
+  // next_[node * classes_ + class]: full DFA after build_links()
+  std::vector<uint32_t> next_;
+  std::vector<uint32_t> fail_;
+  // nearest proper suffix state at which some pattern ends
+  std::vector<uint32_t> dict_;
+  // patterns ending at a state, as a list through next_end_
+  std::vector<uint32_t> first_end_;
+  std::vector<uint32_t> next_end_;
+  std::vector<char> has_output_;
+
+  void build_classes(std::vector<std::string> const& patterns, bool ignore_case) {
+    for (std::string const& p : patterns) {
+      for (char c : p) {
+        unsigned char b = static_cast<unsigned char>(c);
+        uint16_t& cls = class_[ignore_case ? fold_case(b) : b];
+        if (cls == 0) {
+          cls = static_cast<uint16_t>(classes_++);
+        }
+      }
+    }
+    if (ignore_case) {
+      for (unsigned c = 'A'; c <= 'Z'; c++) {
+        class_[c] = class_[fold_case(static_cast<unsigned char>(c))];
+      }
+    }
+  }
+
+  uint32_t add_state() {
+    next_.resize(next_.size() + classes_, 0);
+    first_end_.push_back(none);
+    return static_cast<uint32_t>(first_end_.size() - 1);
+  }
+
+  // node 0 is the root, so 0 marks a missing trie edge
+  void build_trie(std::vector<std::string> const& patterns) {
+    add_state();
+    for (uint32_t id = 0; id < patterns.size(); id++) {
+      uint32_t node = 0;
+      for (char c : patterns[id]) {
+        size_t edge = node * classes_ + class_[static_cast<unsigned char>(c)];
+        if (next_[edge] == 0) {
+          uint32_t child = add_state();
+          next_[edge] = child;
+        }
+        node = next_[edge];
+      }
+      next_end_[id] = first_end_[node];
+      first_end_[node] = id;
+    }
+  }
+
+  void build_links() {
+    size_t n = state_count();
+    fail_.assign(n, 0);
+    dict_.assign(n, none);
+    has_output_.assign(n, 0);
+    has_output_[0] = first_end_[0] != none;
+    std::queue<uint32_t> queue;
+    for (size_t c = 0; c < classes_; c++) {
+      if (next_[c] != 0) {
+        queue.push(next_[c]);
+      }
+    }
+    while (!queue.empty()) {
+      uint32_t node = queue.front();
+      queue.pop();
+      uint32_t f = fail_[node];
+      dict_[node] = first_end_[f] != none ? f : dict_[f];
+      has_output_[node] = first_end_[node] != none || dict_[node] != none;
+      for (size_t c = 0; c < classes_; c++) {
+        uint32_t& child = next_[node * classes_ + c];
+        uint32_t via_fail = next_[f * classes_ + c];
+        if (child != 0) {
+          fail_[child] = via_fail;
+          queue.push(child);
+        } else {
+          child = via_fail;
+        }
+      }
+    }
+  }
+
+  // Walks the output chain of node until it reaches a state whose outputs
+  // were already reported by this search.
+  void report(search_state& st, uint32_t node) const {
+    for (; node != none && !st.done[node]; node = dict_[node]) {
+      st.done[node] = 1;
+      for (uint32_t id = first_end_[node]; id != none; id = next_end_[id]) {
+        if (!st.matched[id]) {
+          st.matched[id] = 1;
+          st.matched_count++;
+        }
+      }
+    }
+  }
+};
@@ -0,0 +1,380 @@
+// Throughput benchmark for the matcher in search.h. Generates corpora from
+// a fixed seed, so runs are comparable across machines and commits, and
+// prints one tab-separated line per configuration:
+//
+//   corpus size pattern_length op source threads seconds gb_per_s matches matches_per_s
+//
+// op "count" counts every occurrence of a pattern taken from the corpus;
+// op "absent" looks for a pattern that does not occur, which is a full scan
+// of the corpus. The adversarial corpus is all 'a' and its pattern is
+// "aa...ab", which defeats the first/last byte filter and exercises the
+// KMP fallback. Each timing is the best of --repeat runs.
+//
+// Source "memory" searches the corpus in memory. The other sources write
+// it to a file under --dir and time opening and reading it the way substr
+// does: "mmap" through the mapping of scan_file, "stream" through the
+// double-buffered reader it uses for pipes, in blocks of --block-size.
+// "warm" reads the file once before the runs, so it is in the page cache;
+// "cold" drops it from the page cache before every run.
+
+#include "input.h"
+#include "parallel.h"
+#include "search.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#ifdef SUBSTR_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+char const usage[] =
+    "Error. Expected [--sizes <bytes>,...] [--lengths <bytes>,...] [--threads <n>,...] "
+    "[--repeat <n>] [--corpus random|dna|log|adversarial]... "
+    "[--source memory|mmap_warm|mmap_cold|stream_warm|stream_cold]... [--dir <path>] "
+    "[--block-size <bytes>]";
+
+char const *const sources[] = {"memory", "mmap_warm", "mmap_cold", "stream_warm", "stream_cold"};
+
+struct options {
+  std::vector<size_t> sizes = {size_t(1) << 20, size_t(1) << 24, size_t(1) << 28};
+  std::vector<size_t> lengths = {2, 4, 8, 16, 32, 64, 256};
+  std::vector<size_t> threads = {1};
+  size_t repeat = 3;
+  std::vector<std::string> corpora;
+  std::vector<std::string> sources;
+  std::string dir;
+  size_t block_size = size_t(1) << 20;
+};
+
+bool parse_list(char const *s, std::vector<size_t> &values) {
+  values.clear();
+  for (;;) {
+    char *end;
+    unsigned long long v = std::strtoull(s, &end, 10);
+    if (end == s || v == 0) {
+      return false;
+    }
+    values.push_back(v);
+    if (*end == '\0') {
+      return true;
+    }
+    if (*end != ',') {
+      return false;
+    }
+    s = end + 1;
+  }
+}
+
+bool parse_options(int argc, char **argv, options &opt) {
+  std::vector<size_t> single;
+  for (int i = 1; i < argc; i++) {
+    bool ok = i + 1 < argc;
+    if (ok && std::strcmp(argv[i], "--sizes") == 0) {
+      ok = parse_list(argv[++i], opt.sizes);
+    } else if (ok && std::strcmp(argv[i], "--lengths") == 0) {
+      ok = parse_list(argv[++i], opt.lengths);
+    } else if (ok && std::strcmp(argv[i], "--threads") == 0) {
+      ok = parse_list(argv[++i], opt.threads);
+    } else if (ok && std::strcmp(argv[i], "--repeat") == 0) {
+      ok = parse_list(argv[++i], single) && single.size() == 1;
+      opt.repeat = ok ? single[0] : 0;
+    } else if (ok && std::strcmp(argv[i], "--corpus") == 0) {
+      opt.corpora.emplace_back(argv[++i]);
+    } else if (ok && std::strcmp(argv[i], "--source") == 0) {
+      opt.sources.emplace_back(argv[++i]);
+    } else if (ok && std::strcmp(argv[i], "--dir") == 0) {
+      opt.dir = argv[++i];
+    } else if (ok && std::strcmp(argv[i], "--block-size") == 0) {
+      ok = parse_list(argv[++i], single) && single.size() == 1;
+      opt.block_size = ok ? single[0] : 0;
+    } else {
+      ok = false;
+    }
+    if (!ok) {
+      std::perror(usage);
+      return false;
+    }
+  }
+  if (opt.corpora.empty()) {
+    opt.corpora = {"random", "dna", "log", "adversarial"};
+  }
+  for (std::string const &corpus : opt.corpora) {
+    if (corpus != "random" && corpus != "dna" && corpus != "log" && corpus != "adversarial") {
+      std::fprintf(stderr, "Error. Unknown corpus: %s\n", corpus.c_str());
+      return false;
+    }
+  }
+  if (opt.sources.empty()) {
+    opt.sources = {"memory"};
+  }
+  for (std::string const &source : opt.sources) {
+    if (std::find(std::begin(sources), std::end(sources), source) == std::end(sources)) {
+      std::fprintf(stderr, "Error. Unknown source: %s\n", source.c_str());
+      return false;
+    }
+#ifndef SUBSTR_MMAP
+    if (source != "memory") {
+      std::fprintf(stderr, "Error. File sources are not supported on this platform\n");
+      return false;
+    }
+#endif
+  }
+  if (opt.dir.empty()) {
+    char const *tmp = std::getenv("TMPDIR");
+    opt.dir = tmp != nullptr ? tmp : "/tmp";
+  }
+  return true;
+}
+
+// Letters, digits and spaces with roughly English frequencies of spaces.
+void random_text(std::mt19937_64 &rng, std::string &out, size_t size) {
+  static char const alphabet[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789     ";
+  std::uniform_int_distribution<size_t> pick(0, sizeof(alphabet) - 2);
+  for (size_t i = 0; i < size; i++) {
+    out[i] = alphabet[pick(rng)];
+  }
+}
+
+void dna(std::mt19937_64 &rng, std::string &out, size_t size) {
+  static char const bases[] = "ACGT";
+  std::uniform_int_distribution<size_t> pick(0, 3);
+  for (size_t i = 0; i < size; i++) {
+    out[i] = bases[pick(rng)];
+  }
+}
+
+// Lines like "2024-03-01T12:34:56.789 INFO  [worker-7] request 51234 done in 12 ms".
+void log_text(std::mt19937_64 &rng, std::string &out, size_t size) {
+  static char const *const levels[] = {"INFO ", "INFO ", "INFO ", "DEBUG", "WARN ", "ERROR"};
+  static char const *const messages[] = {
+      "request %u done in %u ms", "cache miss for key user:%u:%u", "retrying upstream %u, attempt %u",
+      "connection %u closed after %u bytes", "queue depth %u exceeds limit %u"};
+  std::uniform_int_distribution<unsigned> number(0, 99999);
+  std::uniform_int_distribution<size_t> level(0, 5);
+  std::uniform_int_distribution<size_t> message(0, 4);
+  unsigned long long millis = 1709296496789ull;
+  size_t pos = 0;
+  char line[256];
+  char text[128];
+  while (pos < size) {
+    millis += number(rng) % 50;
+    unsigned long long s = millis / 1000;
+    std::snprintf(text, sizeof(text), messages[message(rng)], number(rng), number(rng));
+    int n = std::snprintf(line, sizeof(line), "2024-03-01T%02llu:%02llu:%02llu.%03llu %s [worker-%u] %s\n",
+                          s / 3600 % 24, s / 60 % 60, s % 60, millis % 1000, levels[level(rng)],
+                          number(rng) % 16, text);
+    size_t take = std::min(size - pos, static_cast<size_t>(n));
+    std::memcpy(&out[pos], line, take);
+    pos += take;
+  }
+}
+
+std::string make_corpus(std::string const &kind, size_t size) {
+  std::mt19937_64 rng(size * 31 + kind.size());
+  std::string out(size, 'a');
+  if (kind == "random") {
+    random_text(rng, out, size);
+  } else if (kind == "dna") {
+    dna(rng, out, size);
+  } else if (kind == "log") {
+    log_text(rng, out, size);
+  }
+  // "adversarial" stays all 'a'
+  return out;
+}
+
+struct result {
+  double seconds;
+  uint64_t matches;
+};
+
+// An overlapping count of one buffer, as substr --count does.
+void count(searcher const &search, char const *data, size_t len, scan_workers &workers,
+           std::vector<uint64_t> &counts) {
+  parallel_scan(workers, data, len, search.size() - 1,
+                [&](unsigned worker, char const *piece, size_t n) {
+                  search.for_each(piece, n, 0, 1, [&](size_t) { counts[worker]++; });
+                  return true;
+                });
+}
+
+void fail(char const *what) {
+  std::perror(what);
+  std::exit(-1);
+}
+
+#ifdef SUBSTR_MMAP
+// Writes the corpus to disk, so that its pages can be dropped from the
+// page cache.
+void write_file(std::string const &path, std::string const &text) {
+  FILE *file = std::fopen(path.c_str(), "w");
+  if (file == nullptr) {
+    fail("Error. fopen() failed");
+  }
+  if (std::fwrite(text.data(), 1, text.size(), file) != text.size() || std::fflush(file) != 0 ||
+      fsync(fileno(file)) != 0) {
+    fail("Error. Cannot write the corpus file");
+  }
+  if (std::fclose(file) == EOF) {
+    fail("Error. fclose() failed");
+  }
+}
+
+// Reads the whole file, so that it is in the page cache.
+void warm_up(std::string const &path) {
+  FILE *file = std::fopen(path.c_str(), "r");
+  if (file == nullptr) {
+    fail("Error. fopen() failed");
+  }
+  std::vector<char> buf(size_t(1) << 20);
+  while (std::fread(buf.data(), 1, buf.size(), file) == buf.size()) {
+  }
+  if (std::ferror(file)) {
+    fail("Error. fread() failed");
+  }
+  std::fclose(file);
+}
+
+// The file was synced when written, so none of its pages are dirty and
+// all of them can be dropped.
+void drop_cache(std::string const &path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    fail("Error. open() failed");
+  }
+  int error = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  close(fd);
+  if (error != 0) {
+    errno = error;
+    fail("Error. posix_fadvise() failed");
+  }
+}
+#endif
+
+// Best of `repeat` runs of an overlapping count over the corpus, held in
+// `text` or, for a file source, written to `path`.
+result run(searcher const &search, std::string const &source, std::string const &text,
+           std::string const &path, options const &opt, unsigned threads) {
+  result best{1e100, 0};
+#ifdef SUBSTR_MMAP
+  bool cold = source.ends_with("_cold");
+  if (source.ends_with("_warm")) {
+    warm_up(path);
+  }
+#else
+  (void)path;
+#endif
+  for (size_t r = 0; r < opt.repeat; r++) {
+    std::vector<uint64_t> counts(threads, 0);
+#ifdef SUBSTR_MMAP
+    if (cold) {
+      drop_cache(path);
+    }
+#endif
+    auto start = std::chrono::steady_clock::now();
+    scan_workers workers(threads);
+    if (source == "memory") {
+      count(search, text.data(), text.size(), workers, counts);
+    } else {
+#ifdef SUBSTR_MMAP
+      FILE *file = std::fopen(path.c_str(), "r");
+      if (file == nullptr) {
+        fail("Error. fopen() failed");
+      }
+      auto f = [&](char const *data, size_t len, uint64_t) {
+        count(search, data, len, workers, counts);
+        return true;
+      };
+      bool ok = source.starts_with("mmap") ? scan_file(file, opt.block_size, search.size() - 1, f)
+                                           : scan_stream(file, opt.block_size, search.size() - 1, f);
+      if (!ok) {
+        fail("Error. fread() failed");
+      }
+      std::fclose(file);
+#endif
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    uint64_t matches = 0;
+    for (uint64_t c : counts) {
+      matches += c;
+    }
+    best.seconds = std::min(best.seconds, seconds);
+    best.matches = matches;
+  }
+  return best;
+}
+
+void report(std::string const &corpus, size_t size, size_t length, char const *op,
+            std::string const &source, size_t threads, result r) {
+  double seconds = std::max(r.seconds, 1e-9);
+  std::printf("%s\t%zu\t%zu\t%s\t%s\t%zu\t%.6f\t%.3f\t%llu\t%.0f\n", corpus.c_str(), size, length,
+              op, source.c_str(), threads, r.seconds, size / seconds / 1e9,
+              static_cast<unsigned long long>(r.matches), r.matches / seconds);
+  std::fflush(stdout);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  options opt;
+  if (!parse_options(argc, argv, opt)) {
+    return -1;
+  }
+  bool files = std::any_of(opt.sources.begin(), opt.sources.end(),
+                           [](std::string const &source) { return source != "memory"; });
+  std::printf("corpus\tsize\tpattern_length\top\tsource\tthreads\tseconds\tgb_per_s\tmatches\t"
+              "matches_per_s\n");
+  for (std::string const &corpus : opt.corpora) {
+    for (size_t size : opt.sizes) {
+      std::string text = make_corpus(corpus, size);
+      std::string path = opt.dir + "/substr-bench-" + corpus + "-" + std::to_string(size);
+#ifdef SUBSTR_MMAP
+      if (files) {
+        write_file(path, text);
+      }
+#endif
+      std::mt19937_64 rng(size);
+      for (size_t length : opt.lengths) {
+        if (length > size) {
+          continue;
+        }
+        std::string present;
+        std::string absent;
+        if (corpus == "adversarial") {
+          present = std::string(length, 'a');
+          absent = std::string(length - 1, 'a') + 'b';
+        } else {
+          size_t at = std::uniform_int_distribution<size_t>(0, size - length)(rng);
+          present = text.substr(at, length);
+          // \x01 never occurs in a generated corpus
+          absent = present;
+          absent[length / 2] = '\x01';
+        }
+        for (std::string const &source : opt.sources) {
+          for (size_t threads : opt.threads) {
+            unsigned t = static_cast<unsigned>(threads);
+            report(corpus, size, length, "count", source, threads,
+                   run(searcher(present), source, text, path, opt, t));
+            report(corpus, size, length, "absent", source, threads,
+                   run(searcher(absent), source, text, path, opt, t));
+          }
+        }
+      }
+      if (files) {
+        std::remove(path.c_str());
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,366 @@
+// Behaviour checks for the pieces that split a search: parallel_scan must
+// report every match exactly once, whatever the thread count, the grain
+// and the pattern length, and the candidate blocks of trigram_index must
+// include every block in which a match starts, also when the match runs
+// into later blocks. scan_stream must search input as it arrives and stop
+// without waiting for the rest. Given the path of a built substr, also checks how it
+// reads its command line. Prints every failed check and exits with a
+// non-zero status if any failed.
+
+#include "input.h"
+#include "parallel.h"
+#include "search.h"
+#include "trigram_index.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef SUBSTR_MMAP
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+void check(bool ok, char const *what, int line) {
+  if (!ok) {
+    std::fprintf(stderr, "check.cpp:%d: check failed: %s\n", line, what);
+    failures++;
+  }
+}
+
+// Text over a small alphabet, so that short patterns match often and
+// overlapping matches are common.
+std::string make_text(size_t size, unsigned letters, unsigned seed) {
+  std::mt19937 rng(seed);
+  std::string text(size, 'a');
+  for (char &c : text) {
+    c = static_cast<char>('a' + rng() % letters);
+  }
+  return text;
+}
+
+// Every match start, overlapping ones included.
+std::vector<size_t> naive(std::string const &text, std::string const &pattern) {
+  std::vector<size_t> starts;
+  for (size_t i = 0; i + pattern.size() <= text.size(); i++) {
+    if (text.compare(i, pattern.size(), pattern) == 0) {
+      starts.push_back(i);
+    }
+  }
+  return starts;
+}
+
+// Match starts as found by substr --count -j: each worker searches its
+// pieces on its own, and the pieces overlap by the pattern length minus one.
+std::vector<size_t> scanned(std::string const &text, std::string const &pattern, unsigned threads,
+                            size_t grain) {
+  searcher search(pattern);
+  std::vector<std::vector<size_t>> found(threads);
+  parallel_scan(
+      text.data(), text.size(), pattern.size() - 1, threads,
+      [&](unsigned worker, char const *piece, size_t n) {
+        search.for_each(piece, n, 0, 1,
+                        [&](size_t pos) { found[worker].push_back(piece - text.data() + pos); });
+        return true;
+      },
+      grain);
+  std::vector<size_t> starts;
+  for (std::vector<size_t> const &f : found) {
+    starts.insert(starts.end(), f.begin(), f.end());
+  }
+  std::sort(starts.begin(), starts.end());
+  return starts;
+}
+
+void check_parallel_scan() {
+  std::string text = make_text(5000, 2, 42);
+  std::mt19937 rng(1);
+  for (size_t m : {1, 2, 3, 5, 8, 13, 40}) {
+    std::string pattern = text.substr(rng() % (text.size() - m), m);
+    std::vector<size_t> expected = naive(text, pattern);
+    for (unsigned threads : {1u, 2u, 3u, 4u, 7u}) {
+      // grains shorter than the pattern make pieces that overlap
+      // several others
+      for (size_t grain : {1, 3, 16, 100, 4999, 1 << 20}) {
+        if (scanned(text, pattern, threads, grain) != expected) {
+          std::fprintf(stderr, "check.cpp: pattern of %zu bytes, %u threads, grain %zu\n", m,
+                       threads, grain);
+          CHECK(scanned(text, pattern, threads, grain) == expected);
+        }
+      }
+    }
+  }
+}
+
+// One set of workers serves many buffers in turn, as the windows of a
+// streamed input.
+void check_parallel_reuse() {
+  searcher search("aba");
+  scan_workers workers(3);
+  bool same = true;
+  for (unsigned seed = 0; seed < 50; seed++) {
+    std::string text = make_text(200 + seed * 37, 2, seed);
+    std::vector<size_t> counts(workers.size());
+    parallel_scan(
+        workers, text.data(), text.size(), 2,
+        [&](unsigned worker, char const *piece, size_t n) {
+          search.for_each(piece, n, 0, 1, [&](size_t) { counts[worker]++; });
+          return true;
+        },
+        64);
+    size_t total = 0;
+    for (size_t c : counts) {
+      total += c;
+    }
+    same &= total == naive(text, "aba").size();
+  }
+  CHECK(same);
+}
+
+void check_parallel_stop() {
+  std::string text(10000, 'x');
+  std::vector<size_t> pieces(4);
+  bool finished = parallel_scan(
+      text.data(), text.size(), 0, 4,
+      [&](unsigned worker, char const *, size_t) {
+        pieces[worker]++;
+        return worker != 0;
+      },
+      10);
+  // the other workers stop at some later piece, depending on the timing
+  CHECK(!finished && pieces[0] == 1);
+}
+
+#ifdef SUBSTR_MMAP
+// A new temporary file holding text; empty on failure.
+std::string temp_file(std::string const &text) {
+  char const *tmp = std::getenv("TMPDIR");
+  std::string path = std::string(tmp != nullptr ? tmp : "/tmp") + "/substr-check-XXXXXX";
+  int fd = mkstemp(path.data());
+  if (fd < 0) {
+    std::perror("Error. mkstemp() failed");
+    return {};
+  }
+  bool written = write(fd, text.data(), text.size()) == static_cast<ssize_t>(text.size());
+  close(fd);
+  if (!written) {
+    std::remove(path.c_str());
+    return {};
+  }
+  return path;
+}
+
+// Indexes a text with blocks much shorter than the longer patterns, and
+// looks up patterns placed across block boundaries.
+void check_index_reach() {
+  std::string text = make_text(20000, 6, 7);
+  std::string path = temp_file(text);
+  CHECK(!path.empty());
+  if (path.empty()) {
+    return;
+  }
+  uint32_t const block_size = 16;
+  CHECK(trigram_index::build(path.c_str(), block_size));
+
+  FILE *file = std::fopen(path.c_str(), "r");
+  CHECK(file != nullptr);
+  if (file != nullptr) {
+    trigram_index index(path.c_str(), file);
+    CHECK(index.state() == trigram_index::status::ok && index.block_size() == block_size);
+    bool complete = true;
+    size_t candidates = 0;
+    size_t blocks = 0;
+    for (size_t m : {3, 4, 5, 15, 16, 17, 18, 31, 33, 50}) {
+      // starting at every offset within its block
+      for (size_t at = 1000; at < 1000 + block_size; at++) {
+        std::string pattern = text.substr(at, m);
+        std::vector<uint32_t> found = index.candidates(pattern);
+        complete &= std::is_sorted(found.begin(), found.end());
+        for (size_t start : naive(text, pattern)) {
+          uint32_t block = static_cast<uint32_t>(start / block_size);
+          complete &= std::binary_search(found.begin(), found.end(), block);
+        }
+        candidates += found.size();
+        blocks += (text.size() + block_size - 1) / block_size;
+      }
+    }
+    CHECK(complete);
+    // and still narrows the search down
+    CHECK(candidates < blocks / 4);
+    std::fclose(file);
+  }
+  std::remove(trigram_index::path_for(path.c_str()).c_str());
+  std::remove(path.c_str());
+}
+
+// Matches of "abc" in a pipe fed in pieces, with pauses between them.
+uint64_t count_fed(std::vector<char const *> const &pieces) {
+  int fds[2];
+  if (pipe(fds) != 0) {
+    return UINT64_MAX;
+  }
+  std::thread producer([&] {
+    for (char const *piece : pieces) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      if (write(fds[1], piece, std::strlen(piece)) < 0) {
+        break;
+      }
+    }
+    close(fds[1]);
+  });
+  FILE *in = fdopen(fds[0], "r");
+  searcher search("abc");
+  uint64_t count = 0;
+  auto f = [&](char const *data, size_t len, uint64_t) {
+    search.for_each(data, len, 0, 1, [&](size_t) { count++; });
+    return true;
+  };
+  bool ok = scan_stream(in, 1 << 16, 2, f);
+  producer.join();
+  std::fclose(in);
+  return ok ? count : UINT64_MAX;
+}
+
+void check_stream() {
+  // matches split between reads are stitched together
+  CHECK(count_fed({"xxab", "cxx", "a", "b", "c", "abcab", "c"}) == 4);
+
+  // a scan stopped at the first window returns while the producer is
+  // still there and silent; it gives up after two seconds
+  int fds[2];
+  CHECK(pipe(fds) == 0);
+  CHECK(write(fds[1], "abc", 3) == 3);
+  std::atomic<bool> done{false};
+  std::thread watchdog([&] {
+    for (int i = 0; i < 200 && !done; i++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    close(fds[1]);
+  });
+  FILE *in = fdopen(fds[0], "r");
+  size_t seen = 0;
+  auto f = [&](char const *, size_t len, uint64_t) {
+    seen += len;
+    return false;
+  };
+  auto start = std::chrono::steady_clock::now();
+  bool ok = scan_stream(in, 1 << 20, 2, f);
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  done = true;
+  watchdog.join();
+  std::fclose(in);
+  CHECK(ok && seen == 3);
+  CHECK(seconds < 1);
+}
+
+// What substr prints on stdout, or on stderr if `errors`, and its exit
+// status, given arguments that need no quoting beyond single quotes.
+struct run_result {
+  std::string out;
+  int status = -1;
+};
+
+run_result run(std::string const &substr, std::vector<std::string> const &args,
+               bool errors = false) {
+  std::string command = "'" + substr + "'";
+  for (std::string const &arg : args) {
+    command += " '" + arg + "'";
+  }
+  command += errors ? " 2>&1 >/dev/null" : " 2>/dev/null";
+  run_result r;
+  FILE *pipe = popen(command.c_str(), "r");
+  if (pipe == nullptr) {
+    return r;
+  }
+  char buf[4096];
+  size_t n;
+  while ((n = std::fread(buf, 1, sizeof(buf), pipe)) != 0) {
+    r.out.append(buf, n);
+  }
+  int status = pclose(pipe);
+  r.status = status != -1 && WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+  return r;
+}
+
+bool prints(std::string const &substr, std::vector<std::string> const &args,
+            std::string const &out) {
+  run_result r = run(substr, args);
+  return r.status == 0 && r.out == out;
+}
+
+void check_command_line(std::string const &substr) {
+  std::string path = temp_file("pi -i 3.14 -x\n");
+  CHECK(!path.empty());
+  if (path.empty()) {
+    return;
+  }
+  // <input> <word> takes the word literally, as it always did
+  CHECK(prints(substr, {path, "-i"}, "Yes\n"));
+  CHECK(prints(substr, {path, "--count"}, "No\n"));
+  CHECK(prints(substr, {path, "-y"}, "No\n"));
+  // after -- nothing is an option
+  CHECK(prints(substr, {path, "--", "-x"}, "Yes\n"));
+  CHECK(prints(substr, {"--count", "--", path, "-i"}, "1\n"));
+  CHECK(prints(substr, {"--", path, "--"}, "No\n"));
+  CHECK(prints(substr, {"-i", "--", path, "-I"}, "Yes\n"));
+  CHECK(prints(substr, {"--index", "--", path, "-x"}, "Yes\n"));
+  CHECK(prints(substr, {"-e", "-x", "--", path}, "Yes\n-x\n"));
+  CHECK(prints(substr, {"-i", "-e", "-X", "-e", "-j", path}, "Yes\n-X\n"));
+
+  // a usage error has no errno to report
+  run_result r = run(substr, {path}, true);
+  CHECK(r.status == 255 && r.out.starts_with("Error. Expected"));
+  CHECK(r.out.find("Success") == std::string::npos);
+  std::remove(path.c_str());
+
+  // --index on a directory scans it, and says so
+  char const *tmp = std::getenv("TMPDIR");
+  std::string dir = std::string(tmp != nullptr ? tmp : "/tmp") + "/substr-check-XXXXXX";
+  CHECK(mkdtemp(dir.data()) != nullptr);
+  std::string file = dir + "/text";
+  FILE *out = std::fopen(file.c_str(), "w");
+  CHECK(out != nullptr && std::fputs("pi 3.14\n", out) >= 0 && std::fclose(out) == 0);
+  CHECK(prints(substr, {"--index", dir, "3.14"}, file + ": Yes\n"));
+  r = run(substr, {"--index", dir, "3.14"}, true);
+  CHECK(r.out.starts_with("Warning. The index only serves a single file"));
+  std::remove(file.c_str());
+  std::remove(dir.c_str());
+}
+#endif
+
+} // namespace
+
+int main(int argc, char **argv) {
+  check_parallel_scan();
+  check_parallel_reuse();
+  check_parallel_stop();
+#ifdef SUBSTR_MMAP
+  check_index_reach();
+  check_stream();
+  if (argc > 1) {
+    check_command_line(argv[1]);
+  }
+#else
+  (void)argc;
+  (void)argv;
+#endif
+  if (failures != 0) {
+    std::fprintf(stderr, "%d checks failed\n", failures);
+    return -1;
+  }
+  std::printf("all checks passed\n");
+  return 0;
+}
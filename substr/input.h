@@ -0,0 +1,242 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SUBSTR_MMAP 1
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Feeds the contents of a file to f(data, len, offset) as a sequence of
+// windows, where offset is the position of data[0] in the file.
+// Consecutive windows overlap by `overlap` bytes, so every match of at
+// most overlap + 1 bytes lies wholly inside one of them. f returns false
+// to stop early.
+//
+// Regular files are mapped and passed as a single window, so matching runs
+// directly over the page cache. Pipes and special files are read by a
+// background thread into two alternating buffers of block_size bytes, so
+// reading the next block overlaps searching the current one. A block is
+// handed over as soon as the bytes that have arrived are read, so input
+// from a slow producer is searched as it comes, and the reader gives up
+// waiting for more once f has stopped the scan. The FILE must not have
+// read anything yet.
+//
+// Returns false if reading failed; errno is then set.
+template <typename F>
+bool scan_file(FILE* file, size_t block_size, size_t overlap, F f);
+
+#ifdef SUBSTR_MMAP
+// Read-only mapping of a whole regular file. valid() is false for pipes,
+// special files and files that cannot be mapped. The mapping outlives the
+// FILE it was made from.
+struct file_mapping {
+  explicit file_mapping(FILE* file) {
+    struct stat st;
+    int fd = fileno(file);
+    if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+        static_cast<uint64_t>(st.st_size) > SIZE_MAX) {
+      return;
+    }
+    size_ = st.st_size;
+    if (size_ == 0) {
+      data_ = "";
+      valid_ = true;
+      return;
+    }
+    void* p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+      return;
+    }
+    madvise(p, size_, MADV_SEQUENTIAL);
+    data_ = static_cast<char const*>(p);
+    valid_ = true;
+  }
+
+  file_mapping(file_mapping const&) = delete;
+  file_mapping& operator=(file_mapping const&) = delete;
+
+  ~file_mapping() {
+    if (valid_ && size_ != 0) {
+      munmap(const_cast<char*>(data_), size_);
+    }
+  }
+
+  bool valid() const {
+    return valid_;
+  }
+
+  char const* data() const {
+    return data_;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+private:
+  char const* data_ = nullptr;
+  size_t size_ = 0;
+  bool valid_ = false;
+};
+#endif
+
+#ifdef SUBSTR_MMAP
+// Reads up to `size` bytes: waits for the first ones, checking `stop`
+// every poll_ms, then takes whatever else is ready without waiting.
+// Returns the number of bytes read, which is 0 at the end of the file, on
+// an error (then set in `error`) and once stopped.
+inline size_t read_available(int fd, char* buf, size_t size, std::atomic<bool> const& stop,
+                             int& error) {
+  constexpr int poll_ms = 50;
+  size_t len = 0;
+  while (len < size) {
+    pollfd p{fd, POLLIN, 0};
+    int ready = poll(&p, 1, len == 0 ? poll_ms : 0);
+    if (ready == 0) {
+      if (len != 0 || stop.load()) {
+        return len;
+      }
+      continue;
+    }
+    ssize_t n = ready < 0 ? -1 : read(fd, buf + len, size - len);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      error = errno;
+      return len;
+    }
+    if (n == 0) {
+      return len;
+    }
+    len += n;
+  }
+  return len;
+}
+#endif
+
+template <typename F>
+bool scan_stream(FILE* file, size_t block_size, size_t overlap, F& f) {
+  // Each buffer has `overlap` bytes of room in front of its block for the
+  // tail of the previous window. The reader only writes blocks.
+  struct slot {
+    std::vector<char> buf;
+    size_t len = 0;
+    int error = 0;
+    bool last = false;
+    bool full = false;
+  };
+  slot slots[2];
+  for (slot& s : slots) {
+    s.buf.resize(overlap + block_size);
+  }
+  std::mutex m;
+  std::condition_variable cv;
+  // set under m, and read without it while the reader waits for input
+  std::atomic<bool> stop{false};
+
+  std::thread reader([&] {
+    for (size_t i = 0;; i++) {
+      slot& s = slots[i % 2];
+      {
+        std::unique_lock<std::mutex> lock(m);
+        cv.wait(lock, [&] { return !s.full || stop; });
+        if (stop) {
+          return;
+        }
+      }
+#ifdef SUBSTR_MMAP
+      int error = 0;
+      size_t len = read_available(fileno(file), s.buf.data() + overlap, block_size, stop, error);
+      bool last = len == 0;
+#else
+      size_t len = std::fread(s.buf.data() + overlap, 1, block_size, file);
+      int error = std::ferror(file) ? errno : 0;
+      bool last = len < block_size;
+#endif
+      {
+        std::lock_guard<std::mutex> lock(m);
+        s.len = len;
+        s.error = error;
+        s.last = last;
+        s.full = true;
+      }
+      cv.notify_all();
+      if (last) {
+        return;
+      }
+    }
+  });
+
+  int error = 0;
+  size_t kept = 0;
+  uint64_t offset = 0;
+  for (size_t i = 0;; i++) {
+    slot& s = slots[i % 2];
+    {
+      std::unique_lock<std::mutex> lock(m);
+      cv.wait(lock, [&] { return s.full; });
+    }
+    char* window = s.buf.data() + overlap - kept;
+    if (i > 0) {
+      slot& prev = slots[(i + 1) % 2];
+      std::memcpy(window, prev.buf.data() + overlap + prev.len - kept, kept);
+      {
+        std::lock_guard<std::mutex> lock(m);
+        prev.full = false;
+      }
+      cv.notify_all();
+    }
+    if (s.error != 0) {
+      error = s.error;
+      break;
+    }
+    // the end of the input, after a window that already held its last bytes
+    if (s.last && s.len == 0 && i > 0) {
+      break;
+    }
+    size_t len = kept + s.len;
+    if (!f(static_cast<char const*>(window), len, offset - kept) || s.last) {
+      break;
+    }
+    offset += s.len;
+    kept = std::min(overlap, len);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m);
+    stop = true;
+  }
+  cv.notify_all();
+  reader.join();
+  if (error != 0) {
+    errno = error;
+    return false;
+  }
+  return true;
+}
+
+template <typename F>
+bool scan_file(FILE* file, size_t block_size, size_t overlap, F f) {
+#ifdef SUBSTR_MMAP
+  file_mapping mapping(file);
+  if (mapping.valid()) {
+    f(mapping.data(), mapping.size(), 0);
+    return true;
+  }
+#endif
+  return scan_stream(file, block_size, overlap, f);
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Output buffer that formats numbers itself and hands the stream one large
+// fwrite at a time, so millions of reported matches cost a few system
+// calls instead of millions of fprintf calls. It can also collect the
+// output in a string, to be printed later in a fixed order.
+struct output_buffer {
+  explicit output_buffer(FILE* out, size_t capacity = size_t(1) << 16)
+      : out_(out), buf_(capacity) {}
+
+  explicit output_buffer(std::string& sink, size_t capacity = size_t(1) << 12)
+      : sink_(&sink), buf_(capacity) {}
+
+  output_buffer(output_buffer const&) = delete;
+  output_buffer& operator=(output_buffer const&) = delete;
+
+  ~output_buffer() {
+    flush();
+  }
+
+  void put(std::string_view s) {
+    if (s.size() > buf_.size() - used_) {
+      flush();
+      if (s.size() > buf_.size()) {
+        write(s.data(), s.size());
+        return;
+      }
+    }
+    std::memcpy(buf_.data() + used_, s.data(), s.size());
+    used_ += s.size();
+  }
+
+  void put(char c) {
+    if (used_ == buf_.size()) {
+      flush();
+    }
+    buf_[used_++] = c;
+  }
+
+  void put_line(uint64_t value) {
+    char digits[24];
+    char* end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+    *end++ = '\n';
+    put(std::string_view(digits, end - digits));
+  }
+
+  // Returns false if any write so far has failed.
+  bool flush() {
+    if (used_ != 0) {
+      write(buf_.data(), used_);
+      used_ = 0;
+    }
+    return ok_ && (out_ == nullptr || std::fflush(out_) == 0);
+  }
+
+private:
+  FILE* out_ = nullptr;
+  std::string* sink_ = nullptr;
+  std::vector<char> buf_;
+  size_t used_ = 0;
+  bool ok_ = true;
+
+  void write(char const* data, size_t len) {
+    if (sink_ != nullptr) {
+      sink_->append(data, len);
+    } else {
+      ok_ &= std::fwrite(data, 1, len, out_) == len;
+    }
+  }
+};
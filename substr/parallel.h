@@ -0,0 +1,132 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Threads for parallel_scan, started once per input rather than once per
+// window. run(job) calls job(worker) for every worker, worker 0 on the
+// calling thread, and returns once all calls have returned.
+struct scan_workers {
+  explicit scan_workers(unsigned threads) : size_(std::max(1u, threads)) {
+    for (unsigned worker = 1; worker < size_; worker++) {
+      pool_.emplace_back([this, worker] { serve(worker); });
+    }
+  }
+
+  scan_workers(scan_workers const&) = delete;
+  scan_workers& operator=(scan_workers const&) = delete;
+
+  ~scan_workers() {
+    {
+      std::lock_guard<std::mutex> lock(m_);
+      stop_ = true;
+    }
+    start_.notify_all();
+    for (std::thread& t : pool_) {
+      t.join();
+    }
+  }
+
+  unsigned size() const {
+    return size_;
+  }
+
+  void run(std::function<void(unsigned)> const& job) {
+    {
+      std::lock_guard<std::mutex> lock(m_);
+      job_ = &job;
+      running_ = size_ - 1;
+      round_++;
+    }
+    start_.notify_all();
+    job(0);
+    std::unique_lock<std::mutex> lock(m_);
+    done_.wait(lock, [this] { return running_ == 0; });
+    job_ = nullptr;
+  }
+
+private:
+  unsigned size_;
+  std::vector<std::thread> pool_;
+  std::mutex m_;
+  std::condition_variable start_;
+  std::condition_variable done_;
+  std::function<void(unsigned)> const* job_ = nullptr;
+  // workers still running the current job
+  unsigned running_ = 0;
+  size_t round_ = 0;
+  bool stop_ = false;
+
+  void serve(unsigned worker) {
+    size_t seen = 0;
+    for (;;) {
+      std::function<void(unsigned)> const* job;
+      {
+        std::unique_lock<std::mutex> lock(m_);
+        start_.wait(lock, [&] { return stop_ || round_ != seen; });
+        if (stop_) {
+          return;
+        }
+        seen = round_;
+        job = job_;
+      }
+      (*job)(worker);
+      std::lock_guard<std::mutex> lock(m_);
+      if (--running_ == 0) {
+        done_.notify_one();
+      }
+    }
+  }
+};
+
+// Runs f(worker, data, len) concurrently over workers.size() contiguous
+// ranges of a buffer. The ranges overlap by `overlap` bytes, so every match
+// of at most overlap + 1 bytes lies wholly inside one of them and the
+// combined result equals that of a sequential scan. Each range is fed in
+// pieces of at most `grain` bytes (plus the overlap); a buffer of fewer
+// pieces than workers leaves some of them idle. Once a call returns false,
+// the other workers stop before their next piece and false is returned.
+template <typename F>
+bool parallel_scan(scan_workers& workers, char const* data, size_t len, size_t overlap, F f,
+                   size_t grain = size_t(1) << 20) {
+  size_t useful = (len + grain - 1) / grain;
+  unsigned threads = static_cast<unsigned>(std::min<size_t>(workers.size(), useful));
+  if (threads <= 1) {
+    return f(0u, data, len);
+  }
+
+  std::atomic<bool> stop{false};
+  size_t share = len / threads;
+  workers.run([&](unsigned worker) {
+    if (worker >= threads) {
+      return;
+    }
+    size_t begin = share * worker;
+    size_t end = worker + 1 == threads ? len : begin + share;
+    for (size_t pos = begin; pos < end; pos += grain) {
+      if (stop.load(std::memory_order_relaxed)) {
+        return;
+      }
+      size_t piece_end = std::min(len, std::min(end, pos + grain) + overlap);
+      if (!f(worker, data + pos, piece_end - pos)) {
+        stop.store(true, std::memory_order_relaxed);
+        return;
+      }
+    }
+  });
+  return !stop.load();
+}
+
+// The same with `threads` workers of its own, for a single buffer.
+template <typename F>
+bool parallel_scan(char const* data, size_t len, size_t overlap, unsigned threads, F f,
+                   size_t grain = size_t(1) << 20) {
+  size_t useful = (len + grain - 1) / grain;
+  scan_workers workers(static_cast<unsigned>(std::min<size_t>(threads, useful)));
+  return parallel_scan(workers, data, len, overlap, f, grain);
+}
@@ -0,0 +1,132 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// ASCII case folding; other bytes are left alone.
+inline unsigned char fold_case(unsigned char c) {
+  return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+// Set of byte values that one pattern position accepts.
+struct byte_set {
+  uint64_t bits[4] = {};
+
+  static byte_set of(unsigned char c) {
+    byte_set s;
+    s.add(c);
+    return s;
+  }
+
+  void add(unsigned char c) {
+    bits[c / 64] |= uint64_t(1) << (c % 64);
+  }
+
+  bool contains(unsigned char c) const {
+    return (bits[c / 64] >> (c % 64)) & 1;
+  }
+
+  size_t count() const {
+    size_t n = 0;
+    for (uint64_t w : bits) {
+      n += __builtin_popcountll(w);
+    }
+    return n;
+  }
+
+  void negate() {
+    for (uint64_t& w : bits) {
+      w = ~w;
+    }
+  }
+
+  // Adds the other case of every ASCII letter in the set.
+  void close_case() {
+    for (unsigned c = 'a'; c <= 'z'; c++) {
+      if (contains(c) || contains(c - ('a' - 'A'))) {
+        add(c);
+        add(c - ('a' - 'A'));
+      }
+    }
+  }
+
+  bool operator==(byte_set const&) const = default;
+};
+
+// Turns a pattern into one byte set per position. With `classes`:
+//
+//   ?        any byte
+//   [abc]    any of a, b, c; ranges like [a-z0-9] are allowed, [^...]
+//            accepts every byte not listed, and ] right after [ or [^ is a
+//            literal
+//   \c       the byte c itself, so \? matches ? and \\ a backslash
+//
+// Without it every byte stands for itself. With ignore_case, letters match
+// either case. Returns false on a malformed pattern.
+inline bool compile_pattern(std::string_view pattern, bool classes, bool ignore_case,
+                            std::vector<byte_set>& sets) {
+  sets.clear();
+  for (size_t i = 0; i < pattern.size(); i++) {
+    unsigned char c = pattern[i];
+    byte_set s;
+    if (!classes) {
+      s.add(c);
+    } else if (c == '?') {
+      s.negate();
+    } else if (c == '\\') {
+      if (++i == pattern.size()) {
+        return false;
+      }
+      s.add(pattern[i]);
+    } else if (c == '[') {
+      bool negated = i + 1 < pattern.size() && pattern[i + 1] == '^';
+      i += negated ? 2 : 1;
+      for (size_t first = i;; i++) {
+        if (i == pattern.size()) {
+          return false;
+        }
+        unsigned char lo = pattern[i];
+        if (lo == ']' && i != first) {
+          break;
+        }
+        if (lo == '\\') {
+          if (++i == pattern.size()) {
+            return false;
+          }
+          lo = pattern[i];
+        }
+        unsigned char hi = lo;
+        if (i + 2 < pattern.size() && pattern[i + 1] == '-' && pattern[i + 2] != ']') {
+          i += 2;
+          if (pattern[i] == '\\' && ++i == pattern.size()) {
+            return false;
+          }
+          hi = pattern[i];
+          if (hi < lo) {
+            return false;
+          }
+        }
+        for (unsigned b = lo; b <= hi; b++) {
+          s.add(static_cast<unsigned char>(b));
+        }
+      }
+      if (ignore_case) {
+        // before negating, so [^a] rejects A as well
+        s.close_case();
+      }
+      if (negated) {
+        s.negate();
+      }
+      sets.push_back(s);
+      continue;
+    } else {
+      s.add(c);
+    }
+    if (ignore_case) {
+      s.close_case();
+    }
+    sets.push_back(s);
+  }
+  return true;
+}
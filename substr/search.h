@@ -0,0 +1,452 @@
+#pragma once
+#include "pattern.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SUBSTR_X86 1
+#include <immintrin.h>
+#endif
+
+// Exact substring search. Candidate positions are found by comparing the
+// first and last pattern bytes against 16 or 32 text positions at once and
+// are then verified with memcmp. If verification keeps failing, as with
+// periodic patterns like "aa...ab", the rest of the text is handed to KMP,
+// so the worst case stays linear. The widest kernel the CPU supports is
+// picked once, at construction.
+//
+// A class pattern, with a byte set per position, is filtered the same way
+// on its two most selective positions. Set membership of 16 or 32 bytes is
+// tested at once with nibble lookup tables, so case-insensitive search
+// needs no folded copy of the text. Case-insensitive patterns fall back to
+// KMP over folded bytes; patterns with other classes have no fallback and
+// may take O(nm) on adversarial input.
+struct searcher {
+  static constexpr size_t npos = std::string_view::npos;
+
+  explicit searcher(std::string_view pattern)
+      : pattern_(pattern), prefix_(prefix_function(pattern)), kernel_(pick_kernel()) {}
+
+  explicit searcher(std::vector<byte_set> const& sets) : kernel_(nullptr) {
+    bool literal = true;
+    folded_ = true;
+    for (byte_set const& set : sets) {
+      unsigned char c = 0;
+      while (!set.contains(c) && c != 255) {
+        c++;
+      }
+      byte_set closed = byte_set::of(c);
+      closed.close_case();
+      literal &= set.count() == 1;
+      folded_ &= set == closed;
+      pattern_.push_back(static_cast<char>(c));
+    }
+    if (literal) {
+      folded_ = false;
+      prefix_ = prefix_function(pattern_);
+      kernel_ = pick_kernel();
+      return;
+    }
+    sets_ = sets;
+    if (folded_) {
+      for (char& c : pattern_) {
+        c = static_cast<char>(fold_case(static_cast<unsigned char>(c)));
+      }
+      prefix_ = prefix_function(pattern_);
+    }
+    // the two positions that accept the fewest bytes
+    std::vector<size_t> order(sets.size());
+    for (size_t i = 0; i < order.size(); i++) {
+      order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [&](size_t x, size_t y) { return sets[x].count() < sets[y].count(); });
+    first_ = std::min(order[0], order.size() > 1 ? order[1] : order[0]);
+    second_ = std::max(order[0], order.size() > 1 ? order[1] : order[0]);
+    first_table_ = nibble_table(sets[first_]);
+    second_table_ = nibble_table(sets[second_]);
+    kernel_ = pick_set_kernel();
+  }
+
+  size_t size() const {
+    return pattern_.size();
+  }
+
+  // False for a class pattern, whose pattern() only shows one byte of
+  // every class.
+  bool literal() const {
+    return sets_.empty();
+  }
+
+  std::string const& pattern() const {
+    return pattern_;
+  }
+
+  // Position of the first occurrence that starts at or after `from`, or npos.
+  size_t find(char const* text, size_t len, size_t from = 0) const {
+    size_t m = pattern_.size();
+    if (from > len || len - from < m) {
+      return npos;
+    }
+    if (m == 0) {
+      return from;
+    }
+    if (m == 1 && literal()) {
+      void const* p = std::memchr(text + from, pattern_[0], len - from);
+      return p == nullptr ? npos : static_cast<char const*>(p) - text;
+    }
+    return kernel_(*this, text, len, from);
+  }
+
+  // Calls f(pos) for every occurrence that starts at or after `from`, in
+  // order. With step == size() occurrences do not overlap, otherwise step
+  // is 1. The pattern must not be empty. Once verifying matches costs more
+  // than the scanning budget, KMP takes over, so this stays linear even
+  // when nearly every position matches.
+  template <typename F>
+  void for_each(char const* text, size_t len, size_t from, size_t step, F f) const {
+    size_t work = 0;
+    for (size_t pos = from; (pos = find(text, len, pos)) != npos;) {
+      f(pos);
+      pos += step;
+      work += pattern_.size();
+      if (has_fallback() && over_budget(work, pos - from)) {
+        kmp_each(text, len, pos, step, f);
+        return;
+      }
+    }
+  }
+
+  // Classic prefix function: prefix[i] is the length of the longest proper
+  // border of pattern[0..i].
+  static std::vector<size_t> prefix_function(std::string_view pattern) {
+    std::vector<size_t> prefix(pattern.size());
+    for (size_t i = 1; i < pattern.size(); i++) {
+      size_t prev_pref = prefix[i - 1];
+      while (prev_pref > 0 && pattern[i] != pattern[prev_pref]) {
+        prev_pref = prefix[prev_pref - 1];
+      }
+      if (pattern[i] == pattern[prev_pref]) {
+        prev_pref++;
+      }
+      prefix[i] = prev_pref;
+    }
+    return prefix;
+  }
+
+private:
+  using kernel = size_t (*)(searcher const&, char const*, size_t, size_t);
+
+  // Membership of a byte set, split by nibbles: bit h of low[l] is set if
+  // h * 16 + l is in the set, and bit h - 8 of high[l] if h >= 8.
+  struct nibble_table {
+    nibble_table() = default;
+
+    explicit nibble_table(byte_set const& set) {
+      for (unsigned c = 0; c < 256; c++) {
+        if (!set.contains(static_cast<unsigned char>(c))) {
+          continue;
+        }
+        uint8_t bit = static_cast<uint8_t>(1 << (c / 16 % 8));
+        if (c < 128) {
+          low[c % 16] |= bit;
+        } else {
+          high[c % 16] |= bit;
+        }
+      }
+    }
+
+    alignas(16) uint8_t low[16] = {};
+    alignas(16) uint8_t high[16] = {};
+  };
+
+  // Verification may cost this much plus a few bytes per scanned byte
+  // before the search falls back to KMP.
+  static constexpr size_t verify_slack = 1 << 16;
+
+  std::string pattern_;
+  std::vector<size_t> prefix_;
+  kernel kernel_;
+  // class pattern only
+  std::vector<byte_set> sets_;
+  // every class is one byte in either case; pattern_ is folded
+  bool folded_ = false;
+  size_t first_ = 0;
+  size_t second_ = 0;
+  nibble_table first_table_;
+  nibble_table second_table_;
+
+  // first and last bytes are already known to match
+  bool verify(char const* at) const {
+    size_t m = pattern_.size();
+    return m <= 2 || std::memcmp(at + 1, pattern_.data() + 1, m - 2) == 0;
+  }
+
+  bool verify_set(char const* at) const {
+    for (size_t i = 0; i < sets_.size(); i++) {
+      if (!sets_[i].contains(static_cast<unsigned char>(at[i]))) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool over_budget(size_t work, size_t scanned) const {
+    return work > 4 * scanned + verify_slack;
+  }
+
+  bool has_fallback() const {
+    return sets_.empty() || folded_;
+  }
+
+  char kmp_byte(char c) const {
+    return folded_ ? static_cast<char>(fold_case(static_cast<unsigned char>(c))) : c;
+  }
+
+  size_t kmp(char const* text, size_t len, size_t from) const {
+    size_t m = pattern_.size();
+    size_t state = 0;
+    for (size_t i = from; i < len; i++) {
+      char c = kmp_byte(text[i]);
+      while (state > 0 && c != pattern_[state]) {
+        state = prefix_[state - 1];
+      }
+      if (c == pattern_[state]) {
+        state++;
+      }
+      if (state == m) {
+        return i + 1 - m;
+      }
+    }
+    return npos;
+  }
+
+  template <typename F>
+  void kmp_each(char const* text, size_t len, size_t from, size_t step, F& f) const {
+    size_t m = pattern_.size();
+    size_t state = 0;
+    for (size_t i = from; i < len; i++) {
+      char c = kmp_byte(text[i]);
+      while (state > 0 && c != pattern_[state]) {
+        state = prefix_[state - 1];
+      }
+      if (c == pattern_[state]) {
+        state++;
+      }
+      if (state == m) {
+        f(i + 1 - m);
+        state = step == m ? 0 : prefix_[m - 1];
+      }
+    }
+  }
+
+  static size_t find_scalar(searcher const& s, char const* text, size_t len, size_t from) {
+    size_t m = s.pattern_.size();
+    char first = s.pattern_[0];
+    char last = s.pattern_[m - 1];
+    size_t end = len - m + 1;
+    size_t work = 0;
+    for (size_t i = from; i < end; i++) {
+      void const* p = std::memchr(text + i, first, end - i);
+      if (p == nullptr) {
+        return npos;
+      }
+      i = static_cast<char const*>(p) - text;
+      if (text[i + m - 1] == last) {
+        if (s.verify(text + i)) {
+          return i;
+        }
+        work += m;
+        if (s.over_budget(work, i - from)) {
+          return s.kmp(text, len, i + 1);
+        }
+      }
+    }
+    return npos;
+  }
+
+  static size_t find_set_scalar(searcher const& s, char const* text, size_t len, size_t from) {
+    size_t m = s.sets_.size();
+    byte_set const& first = s.sets_[s.first_];
+    byte_set const& second = s.sets_[s.second_];
+    size_t end = len - m + 1;
+    size_t work = 0;
+    for (size_t i = from; i < end; i++) {
+      if (first.contains(static_cast<unsigned char>(text[i + s.first_])) &&
+          second.contains(static_cast<unsigned char>(text[i + s.second_]))) {
+        if (s.verify_set(text + i)) {
+          return i;
+        }
+        work += m;
+        if (s.folded_ && s.over_budget(work, i - from)) {
+          return s.kmp(text, len, i + 1);
+        }
+      }
+    }
+    return npos;
+  }
+
+#ifdef SUBSTR_X86
+  // 0xff in every lane whose byte is in the set
+  __attribute__((target("ssse3"))) static __m128i members_ssse3(__m128i v, nibble_table const& t) {
+    __m128i nibble = _mm_set1_epi8(0x0f);
+    __m128i lo = _mm_and_si128(v, nibble);
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), nibble);
+    __m128i upper = _mm_cmpgt_epi8(hi, _mm_set1_epi8(7));
+    __m128i rows = _mm_or_si128(
+        _mm_andnot_si128(upper, _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<__m128i const*>(t.low)), lo)),
+        _mm_and_si128(upper, _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<__m128i const*>(t.high)), lo)));
+    __m128i bit = _mm_shuffle_epi8(
+        _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128), hi);
+    return _mm_cmpeq_epi8(_mm_and_si128(rows, bit), bit);
+  }
+
+  __attribute__((target("ssse3"))) static size_t find_set_ssse3(searcher const& s, char const* text,
+                                                                size_t len, size_t from) {
+    size_t m = s.sets_.size();
+    size_t work = 0;
+    size_t i = from;
+    for (; i + m + 15 <= len; i += 16) {
+      __m128i a = _mm_loadu_si128(reinterpret_cast<__m128i const*>(text + i + s.first_));
+      __m128i b = _mm_loadu_si128(reinterpret_cast<__m128i const*>(text + i + s.second_));
+      uint32_t mask = _mm_movemask_epi8(
+          _mm_and_si128(members_ssse3(a, s.first_table_), members_ssse3(b, s.second_table_)));
+      for (; mask != 0; mask &= mask - 1) {
+        size_t pos = i + __builtin_ctz(mask);
+        if (s.verify_set(text + pos)) {
+          return pos;
+        }
+        work += m;
+      }
+      if (s.folded_ && s.over_budget(work, i - from)) {
+        return s.kmp(text, len, i + 16);
+      }
+    }
+    return find_set_scalar(s, text, len, i);
+  }
+
+  __attribute__((target("avx2"))) static __m256i members_avx2(__m256i v, nibble_table const& t) {
+    __m256i nibble = _mm256_set1_epi8(0x0f);
+    __m256i lo = _mm256_and_si256(v, nibble);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble);
+    __m256i upper = _mm256_cmpgt_epi8(hi, _mm256_set1_epi8(7));
+    __m256i low_rows = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<__m128i const*>(t.low)));
+    __m256i high_rows = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<__m128i const*>(t.high)));
+    __m256i rows = _mm256_blendv_epi8(_mm256_shuffle_epi8(low_rows, lo),
+                                      _mm256_shuffle_epi8(high_rows, lo), upper);
+    __m256i bit = _mm256_shuffle_epi8(
+        _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16,
+                         32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128),
+        hi);
+    return _mm256_cmpeq_epi8(_mm256_and_si256(rows, bit), bit);
+  }
+
+  __attribute__((target("avx2"))) static size_t find_set_avx2(searcher const& s, char const* text,
+                                                              size_t len, size_t from) {
+    size_t m = s.sets_.size();
+    size_t work = 0;
+    size_t i = from;
+    for (; i + m + 31 <= len; i += 32) {
+      __m256i a = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(text + i + s.first_));
+      __m256i b = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(text + i + s.second_));
+      uint32_t mask = _mm256_movemask_epi8(
+          _mm256_and_si256(members_avx2(a, s.first_table_), members_avx2(b, s.second_table_)));
+      for (; mask != 0; mask &= mask - 1) {
+        size_t pos = i + __builtin_ctz(mask);
+        if (s.verify_set(text + pos)) {
+          return pos;
+        }
+        work += m;
+      }
+      if (s.folded_ && s.over_budget(work, i - from)) {
+        return s.kmp(text, len, i + 32);
+      }
+    }
+    return find_set_scalar(s, text, len, i);
+  }
+
+  __attribute__((target("sse2"))) static size_t find_sse2(searcher const& s, char const* text,
+                                                          size_t len, size_t from) {
+    size_t m = s.pattern_.size();
+    __m128i first = _mm_set1_epi8(s.pattern_[0]);
+    __m128i last = _mm_set1_epi8(s.pattern_[m - 1]);
+    size_t work = 0;
+    size_t i = from;
+    for (; i + m + 15 <= len; i += 16) {
+      __m128i a = _mm_loadu_si128(reinterpret_cast<__m128i const*>(text + i));
+      __m128i b = _mm_loadu_si128(reinterpret_cast<__m128i const*>(text + i + m - 1));
+      uint32_t mask = _mm_movemask_epi8(
+          _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+      for (; mask != 0; mask &= mask - 1) {
+        size_t pos = i + __builtin_ctz(mask);
+        if (s.verify(text + pos)) {
+          return pos;
+        }
+        work += m;
+      }
+      if (s.over_budget(work, i - from)) {
+        return s.kmp(text, len, i + 16);
+      }
+    }
+    return find_scalar(s, text, len, i);
+  }
+
+  __attribute__((target("avx2"))) static size_t find_avx2(searcher const& s, char const* text,
+                                                          size_t len, size_t from) {
+    size_t m = s.pattern_.size();
+    __m256i first = _mm256_set1_epi8(s.pattern_[0]);
+    __m256i last = _mm256_set1_epi8(s.pattern_[m - 1]);
+    size_t work = 0;
+    size_t i = from;
+    for (; i + m + 31 <= len; i += 32) {
+      __m256i a = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(text + i));
+      __m256i b = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(text + i + m - 1));
+      uint32_t mask = _mm256_movemask_epi8(
+          _mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+      for (; mask != 0; mask &= mask - 1) {
+        size_t pos = i + __builtin_ctz(mask);
+        if (s.verify(text + pos)) {
+          return pos;
+        }
+        work += m;
+      }
+      if (s.over_budget(work, i - from)) {
+        return s.kmp(text, len, i + 32);
+      }
+    }
+    return find_scalar(s, text, len, i);
+  }
+#endif
+
+  static kernel pick_kernel() {
+#ifdef SUBSTR_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+      return find_avx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+      return find_sse2;
+    }
+#endif
+    return find_scalar;
+  }
+
+  static kernel pick_set_kernel() {
+#ifdef SUBSTR_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+      return find_set_avx2;
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+      return find_set_ssse3;
+    }
+#endif
+    return find_set_scalar;
+  }
+};
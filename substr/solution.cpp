@@ -1,75 +1,741 @@
-#include <array>
+#include "aho_corasick.h"
+#include "input.h"
+#include "output.h"
+#include "parallel.h"
+#include "pattern.h"
+#include "search.h"
+#include "thread_pool.h"
+#include "trigram_index.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace {
+
+char const usage[] =
+    "Error. Expected [options] [--] <input>... and <word_to_search_for>, "
+    "or [options] [-e <pattern>]... [-f <pattern file>]... [--] <input>...; inputs may be "
+    "directories, which are searched recursively; arguments after -- and both arguments of "
+    "<input> <word_to_search_for> are never options; options are "
+    "--block-size <bytes>, -j <threads>, --count, --offsets, --non-overlapping, --index, "
+    "--ignore-case, --classes (? is any byte, [a-z] and [^...] are sets, \\ escapes); "
+    "[--block-size <bytes>] --build-index <input file>... writes <input file>.tri";
+
+struct options {
+  size_t block_size = size_t(1) << 20;
+  unsigned threads = 1;
+  // patterns come from -e or -f
+  bool multi = false;
+  bool count = false;
+  bool offsets = false;
+  bool non_overlapping = false;
+  bool build_index = false;
+  // answer from <input>.tri when it is up to date
+  bool use_index = false;
+  bool ignore_case = false;
+  // the pattern uses the class syntax of compile_pattern()
+  bool classes = false;
+  std::vector<std::string> patterns;
+  // the single pattern, compiled
+  std::vector<byte_set> sets;
+  std::vector<char *> inputs;
+};
+
+bool parse_size(char const *s, size_t &value) {
+  char *end;
+  unsigned long long v = std::strtoull(s, &end, 10);
+  if (end == s || *end != '\0' || v > SIZE_MAX / 2) {
+    return false;
+  }
+  value = v;
+  return true;
+}
+
+// One pattern per line.
+bool read_patterns(char const *path, std::vector<std::string> &patterns) {
+  FILE *file = std::fopen(path, "r");
+  if (file == nullptr) {
+    return false;
+  }
+  std::string line;
+  int c;
+  while ((c = std::fgetc(file)) != EOF) {
+    if (c == '\n') {
+      patterns.push_back(std::move(line));
+      line.clear();
+    } else {
+      line.push_back(static_cast<char>(c));
+    }
+  }
+  if (!line.empty()) {
+    patterns.push_back(std::move(line));
+  }
+  bool ok = !std::ferror(file);
+  return std::fclose(file) == 0 && ok;
+}
+
+bool takes_value(char const *arg) {
+  return std::strcmp(arg, "--block-size") == 0 || std::strcmp(arg, "-j") == 0 ||
+         std::strcmp(arg, "-e") == 0 || std::strcmp(arg, "-f") == 0;
+}
+
+// Prints the error itself and returns false on bad arguments.
+bool parse_options(int argc, char **argv, options &opt) {
+  std::vector<char *> positional;
+  // Two arguments keep their original meaning, <input> <word>, even if the
+  // word looks like an option; after -- nothing is an option.
+  bool literal = argc == 3 && !takes_value(argv[1]) && !takes_value(argv[2]);
+  for (int i = 1; i < argc; i++) {
+    if (literal) {
+      positional.push_back(argv[i]);
+    } else if (std::strcmp(argv[i], "--") == 0) {
+      literal = true;
+    } else if (std::strcmp(argv[i], "--block-size") == 0 && i + 1 < argc) {
+      if (!parse_size(argv[++i], opt.block_size) || opt.block_size == 0) {
+        std::fprintf(stderr, "Error. Invalid --block-size: %s\n", argv[i]);
+        return false;
+      }
+    } else if (std::strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+      // -j 0 uses every core
+      size_t jobs;
+      if (!parse_size(argv[++i], jobs) || jobs > 4096) {
+        std::fprintf(stderr, "Error. Invalid -j: %s\n", argv[i]);
+        return false;
+      }
+      opt.threads = jobs != 0 ? static_cast<unsigned>(jobs)
+                              : std::max(1u, std::thread::hardware_concurrency());
+    } else if (std::strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+      opt.patterns.emplace_back(argv[++i]);
+      opt.multi = true;
+    } else if (std::strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+      if (!read_patterns(argv[++i], opt.patterns)) {
+        std::perror("Error. Cannot read pattern file");
+        return false;
+      }
+      opt.multi = true;
+    } else if (std::strcmp(argv[i], "--count") == 0) {
+      opt.count = true;
+    } else if (std::strcmp(argv[i], "--offsets") == 0) {
+      opt.offsets = true;
+    } else if (std::strcmp(argv[i], "--non-overlapping") == 0) {
+      opt.non_overlapping = true;
+    } else if (std::strcmp(argv[i], "--build-index") == 0) {
+      opt.build_index = true;
+    } else if (std::strcmp(argv[i], "--index") == 0) {
+      opt.use_index = true;
+    } else if (std::strcmp(argv[i], "--ignore-case") == 0 || std::strcmp(argv[i], "-i") == 0) {
+      opt.ignore_case = true;
+    } else if (std::strcmp(argv[i], "--classes") == 0) {
+      opt.classes = true;
+    } else {
+      positional.push_back(argv[i]);
+    }
+  }
+  if (opt.build_index) {
+    if (positional.empty() || !opt.patterns.empty()) {
+      std::fprintf(stderr, "%s\n", usage);
+      return false;
+    }
+    opt.inputs = std::move(positional);
+    return true;
+  }
+  // with -e or -f every positional argument is an input
+  if (!opt.multi && positional.size() >= 2) {
+    opt.patterns.emplace_back(positional.back());
+    positional.pop_back();
+  }
+  if (positional.empty() || (!opt.multi && opt.patterns.empty())) {
+    std::fprintf(stderr, "%s\n", usage);
+    return false;
+  }
+  if (opt.multi && opt.classes) {
+    std::fprintf(stderr, "Error. --classes needs a single pattern\n");
+    return false;
+  }
+  if (!opt.multi && !compile_pattern(opt.patterns[0], opt.classes, opt.ignore_case, opt.sets)) {
+    std::fprintf(stderr, "Error. Invalid pattern: %s\n", opt.patterns[0].c_str());
+    return false;
+  }
+  if ((opt.count || opt.offsets) && (opt.multi || opt.sets.empty())) {
+    std::fprintf(stderr, "Error. --count and --offsets need a single non-empty pattern\n");
+    return false;
+  }
+  if (opt.use_index && (opt.multi || positional.size() != 1)) {
+    std::fprintf(stderr, "Error. --index needs a single pattern and a single input file\n");
+    return false;
+  }
+  opt.inputs = std::move(positional);
+  return true;
+}
+
+// The matcher for the given patterns, built once and shared by every file
+// and thread.
+struct matcher {
+  explicit matcher(options const &opt) {
+    if (opt.multi) {
+      ac.emplace(opt.patterns, opt.ignore_case);
+      for (std::string const &p : opt.patterns) {
+        overlap = std::max(overlap, p.size() > 0 ? p.size() - 1 : 0);
+      }
+    } else {
+      search.emplace(opt.sets);
+      overlap = search->size() > 0 ? search->size() - 1 : 0;
+    }
+  }
+
+  std::optional<searcher> search;
+  std::optional<aho_corasick> ac;
+  // independently scanned pieces must overlap by this much
+  size_t overlap = 0;
+};
+
+// The search functions below start their opt.threads workers once and
+// hand them every window of the input. They add the number of bytes
+// handed to the matcher to `scanned`: overlaps count once per piece that
+// contains them, and a search that stops at a match counts the bytes up to
+// its end.
+bool find_single(FILE *file, options const &opt, searcher const &search, bool &found,
+                 std::atomic<uint64_t> &scanned) {
+  size_t overlap = search.size() > 0 ? search.size() - 1 : 0;
+  std::atomic<bool> any{false};
+  scan_workers workers(opt.threads);
+  bool ok = scan_file(file, opt.block_size, overlap, [&](char const *data, size_t len, uint64_t) {
+    return parallel_scan(workers, data, len, overlap,
+                         [&](unsigned, char const *piece, size_t n) {
+                           size_t pos = search.find(piece, n);
+                           if (pos != searcher::npos) {
+                             any = true;
+                             n = pos + search.size();
+                           }
+                           scanned += n;
+                           return !any;
+                         });
+  });
+  found = any;
+  return ok;
+}
+
+bool find_multi(FILE *file, options const &opt, aho_corasick const &ac,
+                std::vector<char> &matched, std::atomic<uint64_t> &scanned) {
+  std::vector<aho_corasick::search_state> states(opt.threads, aho_corasick::search_state(ac));
+  // A single thread carries the automaton state across blocks, so they
+  // need no overlap. Parallel pieces are scanned independently and must
+  // overlap by the longest pattern.
+  size_t overlap = 0;
+  if (opt.threads > 1) {
+    for (std::string const &p : opt.patterns) {
+      overlap = std::max(overlap, p.size() > 0 ? p.size() - 1 : 0);
+    }
+  }
+  scan_workers workers(opt.threads);
+  bool ok = scan_file(file, opt.block_size, overlap, [&](char const *data, size_t len, uint64_t) {
+    return parallel_scan(workers, data, len, overlap,
+                         [&](unsigned worker, char const *piece, size_t n) {
+                           if (opt.threads > 1) {
+                             states[worker].node = 0;
+                           }
+                           scanned += n;
+                           return ac.scan(states[worker], piece, n);
+                         });
+  });
+  matched.assign(opt.patterns.size(), 0);
+  for (aho_corasick::search_state const &st : states) {
+    for (size_t i = 0; i < matched.size(); i++) {
+      matched[i] |= st.matched[i];
+    }
+  }
+  return ok;
+}
+
+// Every match of the pattern, in file order. Consecutive windows overlap by
+// less than the pattern length, so no match is seen twice. Overlapping
+// counts without --offsets run in parallel; the greedy non-overlapping
+// scan and the ordered offset list are sequential.
+bool count_single(FILE *file, options const &opt, searcher const &search, output_buffer &out,
+                  uint64_t &total, std::atomic<uint64_t> &scanned) {
+  size_t m = search.size();
+  size_t step = opt.non_overlapping ? m : 1;
+  bool parallel = opt.threads > 1 && !opt.offsets && !opt.non_overlapping;
+  std::vector<uint64_t> counts(parallel ? opt.threads : 1, 0);
+  // file offset where the next match may start
+  uint64_t resume = 0;
+  scan_workers workers(parallel ? opt.threads : 1);
+  bool ok = scan_file(file, opt.block_size, m - 1, [&](char const *data, size_t len, uint64_t offset) {
+    if (parallel) {
+      parallel_scan(workers, data, len, m - 1, [&](unsigned worker, char const *piece, size_t n) {
+        search.for_each(piece, n, 0, step, [&](size_t) { counts[worker]++; });
+        scanned += n;
+        return true;
+      });
+      return true;
+    }
+    size_t from = resume > offset ? resume - offset : 0;
+    scanned += len - std::min(from, len);
+    search.for_each(data, len, from, step, [&](size_t pos) {
+      counts[0]++;
+      if (opt.offsets) {
+        out.put_line(offset + pos);
+      }
+      resume = offset + pos + step;
+    });
+    return true;
+  });
+  total = 0;
+  for (uint64_t c : counts) {
+    total += c;
+  }
+  return ok;
+}
+
+#ifdef SUBSTR_MMAP
+// Answers the query from the trigram index of the file, searching only the
+// candidate blocks. Each one is searched with the pattern length minus one
+// bytes of the next block, so that matches starting in it are seen whole.
+// Returns false, after a warning where one is due, if the index cannot be
+// used; the caller then scans the whole file.
+bool query_index(char const *path, FILE *file, options const &opt, searcher const &search,
+                 output_buffer &out, bool &found, uint64_t &total) {
+  size_t m = search.size();
+  if (!search.literal()) {
+    std::fprintf(stderr, "Warning. The index only serves exact patterns, scanning the whole file\n");
+    return false;
+  }
+  if (m < 3) {
+    return false;
+  }
+  trigram_index index(path, file);
+  switch (index.state()) {
+  case trigram_index::status::ok:
+    break;
+  case trigram_index::status::missing:
+    std::fprintf(stderr, "Warning. No index for %s, scanning the whole file\n", path);
+    return false;
+  case trigram_index::status::stale:
+    std::fprintf(stderr, "Warning. Index of %s is out of date, scanning the whole file\n", path);
+    return false;
+  case trigram_index::status::corrupt:
+    std::fprintf(stderr, "Warning. Index of %s is damaged, scanning the whole file\n", path);
+    return false;
+  }
+  file_mapping mapping(file);
+  if (!mapping.valid()) {
+    return false;
+  }
+
+  size_t step = opt.non_overlapping ? m : 1;
+  size_t len = mapping.size();
+  size_t resume = 0;
+  total = 0;
+  for (uint32_t block : index.candidates(search.pattern())) {
+    size_t begin = size_t(block) * index.block_size();
+    if (begin >= len) {
+      break;
+    }
+    size_t end = std::min(len, begin + index.block_size() + m - 1);
+    if (!opt.count && !opt.offsets) {
+      if (search.find(mapping.data(), end, begin) != searcher::npos) {
+        found = true;
+        break;
+      }
+      continue;
+    }
+    search.for_each(mapping.data(), end, std::max(begin, resume), step, [&](size_t pos) {
+      total++;
+      if (opt.offsets) {
+        out.put_line(pos);
+      }
+      resume = pos + step;
+    });
+  }
+  return true;
+}
+#endif
+
+// Builds <input>.tri for every input. Index blocks are 64 KiB, or the
+// --block-size if that is smaller.
+int build_indexes(options const &opt) {
+#ifdef SUBSTR_MMAP
+  int result = 0;
+  for (char *input : opt.inputs) {
+    uint32_t block_size = static_cast<uint32_t>(
+        std::min<size_t>(opt.block_size, trigram_index::default_block_size));
+    if (!trigram_index::build(input, block_size)) {
+      std::fprintf(stderr, "Error. Cannot index %s: %s\n", input, std::strerror(errno));
+      result = -1;
+    }
+  }
+  return result;
+#else
+  (void)opt;
+  std::fprintf(stderr, "Error. Indexes are not supported on this platform\n");
+  return -1;
+#endif
+}
+
+// Multi-file mode. Every file gets its own result, filled in by whichever
+// worker searches it and printed in input order once all are done.
+struct file_result {
+  std::string path;
+  uint64_t size = 0;
+  // found, or every pattern found: later chunks can be skipped
+  std::atomic<bool> done{false};
+  std::atomic<uint64_t> count{0};
+  // bytes handed to the matcher, for the throughput summary
+  std::atomic<uint64_t> scanned{0};
+  std::mutex m;
+  std::vector<char> matched;
+  // --offsets output, one offset per line
+  std::string offsets;
+  int error = 0;
+  char const *what = nullptr;
+};
+
+// Files at least this large are split into chunks of chunk_bytes, searched
+// by different workers. Files smaller than small_file are searched in
+// batches of up to batch_files files or batch_bytes bytes per task.
+constexpr uint64_t chunk_bytes = uint64_t(8) << 20;
+constexpr uint64_t split_file = 4 * chunk_bytes;
+constexpr uint64_t small_file = uint64_t(1) << 20;
+constexpr uint64_t batch_bytes = uint64_t(8) << 20;
+constexpr size_t batch_files = 256;
+
+void fail(file_result &r, char const *what) {
+  std::lock_guard<std::mutex> lock(r.m);
+  if (r.what == nullptr) {
+    r.error = errno;
+    r.what = what;
+  }
+}
+
+// Searches a whole file on the calling thread.
+void search_file(file_result &r, options const &opt, matcher const &match) {
+  FILE *file = std::fopen(r.path.c_str(), "r");
+  if (file == nullptr) {
+    fail(r, "fopen() failed");
+    return;
+  }
+  bool ok;
+  if (opt.count || opt.offsets) {
+    output_buffer out(r.offsets);
+    uint64_t total = 0;
+    ok = count_single(file, opt, *match.search, out, total, r.scanned);
+    r.count = total;
+  } else if (opt.multi) {
+    std::vector<char> matched;
+    ok = find_multi(file, opt, *match.ac, matched, r.scanned);
+    r.matched = std::move(matched);
+  } else {
+    bool found = false;
+    ok = find_single(file, opt, *match.search, found, r.scanned);
+    r.done = found;
+  }
+  if (!ok) {
+    fail(r, "fread() failed");
+  }
+  if (std::fclose(file) == EOF) {
+    fail(r, "fclose() failed");
+  }
+}
+
+// Searches bytes [begin, end) of a mapped file, plus the overlap, so that
+// every match starting in the range is seen exactly once.
+void search_chunk(file_result &r, options const &opt, matcher const &match, char const *data,
+                  size_t len, size_t begin, size_t end) {
+  if (r.done.load(std::memory_order_relaxed)) {
+    return;
+  }
+  char const *piece = data + begin;
+  size_t n = std::min(len, end + match.overlap) - begin;
+  if (opt.count) {
+    uint64_t count = 0;
+    match.search->for_each(piece, n, 0, 1, [&](size_t) { count++; });
+    r.count += count;
+    r.scanned += n;
+  } else if (opt.multi) {
+    aho_corasick::search_state st(*match.ac);
+    match.ac->scan(st, piece, n);
+    r.scanned += n;
+    std::lock_guard<std::mutex> lock(r.m);
+    size_t found = 0;
+    for (size_t i = 0; i < r.matched.size(); i++) {
+      r.matched[i] |= st.matched[i];
+      found += r.matched[i] != 0;
+    }
+    if (found == r.matched.size()) {
+      r.done = true;
+    }
+  } else {
+    size_t pos = match.search->find(piece, n);
+    if (pos != searcher::npos) {
+      r.done = true;
+      n = pos + match.search->size();
+    }
+    r.scanned += n;
+  }
+}
+
+// Maps a large file and hands its chunks to the pool. They land on this
+// worker's queue, from which idle workers steal them.
+void split_file_search(work_stealing_pool &pool, file_result &r, options const &opt,
+                       matcher const &match) {
+#ifdef SUBSTR_MMAP
+  FILE *file = std::fopen(r.path.c_str(), "r");
+  if (file == nullptr) {
+    fail(r, "fopen() failed");
+    return;
+  }
+  auto mapping = std::make_shared<file_mapping>(file);
+  if (std::fclose(file) == EOF) {
+    fail(r, "fclose() failed");
+    return;
+  }
+  if (mapping->valid()) {
+    if (opt.multi) {
+      r.matched.assign(opt.patterns.size(), 0);
+    }
+    for (size_t begin = 0; begin < mapping->size(); begin += chunk_bytes) {
+      size_t end = std::min<size_t>(mapping->size(), begin + chunk_bytes);
+      pool.submit([&r, &opt, &match, mapping, begin, end] {
+        search_chunk(r, opt, match, mapping->data(), mapping->size(), begin, end);
+      });
+    }
+    return;
+  }
+#endif
+  (void)pool;
+  search_file(r, opt, match);
+}
+
+// Collects the regular files under a directory, sorted by path so the
+// output does not depend on the directory order on disk.
+bool walk(char const *root, std::vector<std::string> &paths) {
+  namespace fs = std::filesystem;
+  std::error_code ec;
+  if (!fs::is_directory(root, ec)) {
+    paths.emplace_back(root);
+    return true;
+  }
+  std::vector<std::string> found;
+  fs::recursive_directory_iterator it(root, fs::directory_options::skip_permission_denied, ec);
+  for (; !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+    if (it->is_regular_file(ec)) {
+      found.push_back(it->path().string());
+    }
+  }
+  if (ec) {
+    std::fprintf(stderr, "Error. Cannot walk %s: %s\n", root, ec.message().c_str());
+    return false;
+  }
+  std::sort(found.begin(), found.end());
+  paths.insert(paths.end(), found.begin(), found.end());
+  return true;
+}
+
+void put_result(output_buffer &out, file_result const &r, options const &opt) {
+  std::string_view prefix = r.path;
+  if (opt.offsets) {
+    std::string_view lines = r.offsets;
+    for (size_t eol; (eol = lines.find('\n')) != std::string_view::npos;
+         lines.remove_prefix(eol + 1)) {
+      out.put(prefix);
+      out.put(": ");
+      out.put(lines.substr(0, eol + 1));
+    }
+  }
+  if (opt.count) {
+    out.put(prefix);
+    out.put(": ");
+    out.put_line(r.count);
+  } else if (!opt.offsets) {
+    bool found = r.done;
+    for (char m : r.matched) {
+      found |= m != 0;
+    }
+    out.put(prefix);
+    out.put(found ? ": Yes\n" : ": No\n");
+    for (size_t i = 0; i < r.matched.size(); i++) {
+      if (r.matched[i]) {
+        out.put(prefix);
+        out.put(": ");
+        out.put(opt.patterns[i]);
+        out.put('\n');
+      }
+    }
+  }
+}
+
+// Searches every file under the inputs on a pool of opt.threads workers.
+// Each file is searched sequentially by one worker, except that large
+// files are split into chunks when the mode allows it: the ordered offset
+// list and the greedy non-overlapping count need a single pass.
+int search_tree(options const &opt, matcher const &match) {
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::string> paths;
+  bool walked = true;
+  for (char *input : opt.inputs) {
+    walked &= walk(input, paths);
+  }
+
+  std::vector<file_result> results(paths.size());
+  bool splittable = opt.threads > 1 && !opt.offsets && !opt.non_overlapping;
+  options serial = opt;
+  serial.threads = 1;
+  {
+    work_stealing_pool pool(opt.threads);
+    std::vector<file_result *> batch;
+    uint64_t batch_size = 0;
+    auto submit_batch = [&] {
+      pool.submit([batch, &serial, &match] {
+        for (file_result *r : batch) {
+          search_file(*r, serial, match);
+        }
+      });
+      batch.clear();
+      batch_size = 0;
+    };
+    for (size_t i = 0; i < paths.size(); i++) {
+      file_result &r = results[i];
+      r.path = std::move(paths[i]);
+      std::error_code ec;
+      bool regular = std::filesystem::is_regular_file(r.path, ec);
+      r.size = regular ? std::filesystem::file_size(r.path, ec) : 0;
+      if (regular && !ec && r.size < small_file) {
+        batch.push_back(&r);
+        batch_size += r.size;
+        if (batch.size() == batch_files || batch_size >= batch_bytes) {
+          submit_batch();
+        }
+      } else if (regular && !ec && splittable && r.size >= split_file) {
+        pool.submit([&pool, &r, &serial, &match] { split_file_search(pool, r, serial, match); });
+      } else {
+        pool.submit([&r, &serial, &match] { search_file(r, serial, match); });
+      }
+    }
+    if (!batch.empty()) {
+      submit_batch();
+    }
+    pool.wait();
+  }
+  double seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  output_buffer out(stdout);
+  bool ok = walked;
+  uint64_t bytes = 0;
+  for (file_result const &r : results) {
+    if (r.what != nullptr) {
+      std::fprintf(stderr, "Error. %s: %s: %s\n", r.what, r.path.c_str(), std::strerror(r.error));
+      ok = false;
+      continue;
+    }
+    bytes += r.scanned;
+    put_result(out, r, opt);
+  }
+  if (!out.flush()) {
+    std::perror("Error. fwrite() failed");
+    return -1;
+  }
+  std::fprintf(stderr, "Searched %zu files, scanned %llu bytes in %.3f s (%.2f GB/s)\n", results.size(),
+               static_cast<unsigned long long>(bytes), seconds,
+               seconds > 0 ? bytes / seconds / 1e9 : 0.0);
+  return ok ? 0 : -1;
+}
+
+} // namespace
 
 int main(int argc, char **argv) {
-  if (argc != 3) {
-    std::perror("Error. Expected <input file> and <word_to_search_for>");
+  options opt;
+  if (!parse_options(argc, argv, opt)) {
     return -1;
   }
+  if (opt.build_index) {
+    return build_indexes(opt);
+  }
+  matcher match(opt);
+
+  std::error_code ec;
+  if (opt.inputs.size() > 1 || std::filesystem::is_directory(opt.inputs[0], ec)) {
+    if (opt.use_index) {
+      std::fprintf(stderr,
+                   "Warning. The index only serves a single file, scanning every file in full\n");
+    }
+    return search_tree(opt, match);
+  }
 
-  FILE *file = std::fopen(argv[1], "r");
+  FILE *file = std::fopen(opt.inputs[0], "r");
   if (file == nullptr) {
     std::perror("Error. fopen() failed");
     return -1;
   }
 
-  char buf[4097];
-  std::array<int, 260> prefix_value{};
-  size_t search_string_length = strlen(argv[2]);
-  size_t read_len, last_prefix_func_val = 0;
-  for (size_t i = 1; i < search_string_length; i++) {
-    prefix_value[i] = 0;
-    int prev_pref = prefix_value[i - 1];
-    while (prev_pref > 0 && argv[2][i] != argv[2][prev_pref]) {
-      prev_pref = prefix_value[prev_pref - 1];
-    }
-    if (argv[2][i] == argv[2][prev_pref]) {
-      prev_pref++;
+  output_buffer out(stdout);
+  std::vector<char> matched(1, 0);
+  uint64_t total = 0;
+  bool found = false;
+  bool ok = true;
+  std::atomic<uint64_t> scanned{0};
+#ifdef SUBSTR_MMAP
+  bool indexed = opt.use_index && query_index(opt.inputs[0], file, opt, *match.search, out, found, total);
+#else
+  bool indexed = false;
+#endif
+  if (indexed) {
+    // answered from the index
+  } else if (opt.count || opt.offsets) {
+    ok = count_single(file, opt, *match.search, out, total, scanned);
+  } else if (opt.multi) {
+    ok = find_multi(file, opt, *match.ac, matched, scanned);
+  } else {
+    ok = find_single(file, opt, *match.search, found, scanned);
+  }
+  if (!ok) {
+    std::perror("Error. fread() failed");
+    if (std::fclose(file) == EOF) {
+      std::perror("Error. fclose() failed");
     }
-    prefix_value[i] = prev_pref;
+    return -1;
   }
-  prefix_value[search_string_length] = 0;
 
-  do {
-    read_len = std::fread(buf, 1, 4096, file);
-    if (read_len != 4096) {
-      if (std::ferror(file)) {
-        std::perror("Error. fread() failed");
-        if (std::fclose(file) == EOF) {
-          std::perror("Error. fclose() failed");
-          return -1;
+  if (opt.count) {
+    out.put_line(total);
+  } else if (!opt.offsets) {
+    for (char m : matched) {
+      found |= m != 0;
+    }
+    out.put(found ? "Yes\n" : "No\n");
+    if (opt.multi) {
+      // which patterns matched, in the order they were given
+      for (size_t i = 0; i < opt.patterns.size(); i++) {
+        if (matched[i]) {
+          out.put(opt.patterns[i]);
+          out.put('\n');
         }
-        return -1;
-      } 
-    }
-    size_t max_value = 0;
-    for (size_t i = 0; i < read_len; i++) {
-      size_t prev_pref = last_prefix_func_val;
-      while (prev_pref > 0 && buf[i] != argv[2][prev_pref]) {
-        prev_pref = prefix_value[prev_pref - 1];
-      }
-      if (buf[i] == argv[2][prev_pref]) {
-        prev_pref++;
       }
-      last_prefix_func_val = prev_pref;
-      max_value = (max_value > last_prefix_func_val) ? max_value : last_prefix_func_val;
-    }
-    if (max_value >= search_string_length) {
-      std::fprintf(stdout, "Yes\n");
-      if (std::fclose(file) == EOF) {
-        std::perror("Error. fclose() failed");
-        return -1;
-      }
-      return 0;
     }
-  } while (read_len > 0);
-
-  std::fprintf(stdout, "No");
+  }
+  if (!out.flush()) {
+    std::perror("Error. fwrite() failed");
+    std::fclose(file);
+    return -1;
+  }
   if (std::fclose(file) == EOF) {
     std::perror("Error. fclose() failed");
     return -1;
   }
-  std::fprintf(stdout, "\n");
   return 0;
-}
\ No newline at end of file
+}
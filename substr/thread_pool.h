@@ -0,0 +1,122 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of workers with a task deque each. A worker runs its own newest
+// task first and, when it has none, steals the oldest task of another
+// worker. Tasks submitted from a worker go to that worker's deque.
+struct work_stealing_pool {
+  explicit work_stealing_pool(unsigned threads) : queues_(std::max(1u, threads)) {
+    for (size_t i = 0; i < queues_.size(); i++) {
+      workers_.emplace_back([this, i] { run(i); });
+    }
+  }
+
+  work_stealing_pool(work_stealing_pool const&) = delete;
+  work_stealing_pool& operator=(work_stealing_pool const&) = delete;
+
+  ~work_stealing_pool() {
+    {
+      std::lock_guard<std::mutex> lock(m_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread& t : workers_) {
+      t.join();
+    }
+  }
+
+  void submit(std::function<void()> task) {
+    size_t q = current_pool_ == this ? current_worker_ : next_queue_++ % queues_.size();
+    {
+      std::lock_guard<std::mutex> lock(m_);
+      queued_++;
+      pending_++;
+    }
+    {
+      std::lock_guard<std::mutex> lock(queues_[q].m);
+      queues_[q].tasks.push_back(std::move(task));
+    }
+    wake_.notify_one();
+  }
+
+  // Blocks until every submitted task has finished.
+  void wait() {
+    std::unique_lock<std::mutex> lock(m_);
+    idle_.wait(lock, [this] { return pending_ == 0; });
+  }
+
+private:
+  struct queue {
+    std::mutex m;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  static inline thread_local work_stealing_pool* current_pool_ = nullptr;
+  static inline thread_local size_t current_worker_ = 0;
+
+  std::vector<queue> queues_;
+  std::vector<std::thread> workers_;
+  size_t next_queue_ = 0;
+
+  std::mutex m_;
+  std::condition_variable wake_;
+  std::condition_variable idle_;
+  size_t queued_ = 0;
+  // submitted and not finished
+  size_t pending_ = 0;
+  bool stop_ = false;
+
+  bool try_pop(size_t self, std::function<void()>& task) {
+    {
+      queue& own = queues_[self];
+      std::lock_guard<std::mutex> lock(own.m);
+      if (!own.tasks.empty()) {
+        task = std::move(own.tasks.back());
+        own.tasks.pop_back();
+        return true;
+      }
+    }
+    for (size_t k = 1; k < queues_.size(); k++) {
+      queue& victim = queues_[(self + k) % queues_.size()];
+      std::lock_guard<std::mutex> lock(victim.m);
+      if (!victim.tasks.empty()) {
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void run(size_t self) {
+    current_pool_ = this;
+    current_worker_ = self;
+    for (;;) {
+      std::function<void()> task;
+      if (try_pop(self, task)) {
+        {
+          std::lock_guard<std::mutex> lock(m_);
+          queued_--;
+        }
+        task();
+        std::lock_guard<std::mutex> lock(m_);
+        if (--pending_ == 0) {
+          idle_.notify_all();
+        }
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(m_);
+      wake_.wait(lock, [this] { return stop_ || queued_ > 0; });
+      if (stop_ && queued_ == 0) {
+        return;
+      }
+    }
+  }
+};
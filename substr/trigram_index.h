@@ -0,0 +1,332 @@
+#pragma once
+#include "input.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef SUBSTR_MMAP
+#include <sys/stat.h>
+
+// Persistent index of the trigrams of a file, kept next to it as
+// <file>.tri. The file is cut into blocks, and for every trigram the index
+// lists the blocks in which it starts. A query intersects these lists for
+// the trigrams of the pattern, so only the few candidate blocks need to be
+// searched. The index records the size and mtime of the file and is
+// ignored once either changes.
+//
+// Layout, in host byte order: a header, one entry per trigram that occurs,
+// sorted by trigram, and the postings. The postings of a trigram are its
+// block numbers, delta coded as LEB128 varints. Queries read the index
+// through a mapping, so only the entries and postings they touch are
+// paged in.
+struct trigram_index {
+  static constexpr uint32_t default_block_size = 1 << 16;
+
+  enum class status { ok, missing, stale, corrupt };
+
+  static std::string path_for(char const* path) {
+    return std::string(path) + ".tri";
+  }
+
+  // Indexes the regular file at path. Returns false on failure; errno is
+  // then set.
+  static bool build(char const* path, uint32_t block_size = default_block_size);
+
+  // Opens the index of the file at path; file is that file, already open.
+  trigram_index(char const* path, FILE* file);
+
+  status state() const {
+    return state_;
+  }
+
+  uint32_t block_size() const {
+    return header_.block_size;
+  }
+
+  // Blocks in which a match of pattern may start, in ascending order. The
+  // pattern must be at least three bytes long.
+  std::vector<uint32_t> candidates(std::string_view pattern) const;
+
+private:
+  static constexpr char magic[8] = {'S', 'U', 'B', 'S', 'T', 'R', 'T', 'I'};
+  static constexpr uint32_t version = 1;
+  static constexpr uint32_t trigram_space = 1 << 24;
+
+  struct header {
+    char magic[8];
+    uint32_t version;
+    uint32_t block_size;
+    uint64_t file_size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t entry_count;
+    uint64_t postings_size;
+  };
+
+  struct entry {
+    uint32_t trigram;
+    // postings bytes, which also ranks trigrams by rarity
+    uint32_t size;
+    uint64_t offset;
+  };
+
+  status state_ = status::missing;
+  header header_{};
+  std::unique_ptr<file_mapping> mapping_;
+  entry const* entries_ = nullptr;
+  unsigned char const* postings_ = nullptr;
+
+  static uint32_t trigram_at(char const* p) {
+    return uint32_t(static_cast<unsigned char>(p[0])) << 16 |
+           uint32_t(static_cast<unsigned char>(p[1])) << 8 | static_cast<unsigned char>(p[2]);
+  }
+
+  static size_t varint_size(uint32_t value) {
+    size_t size = 1;
+    for (; value >= 0x80; value >>= 7) {
+      size++;
+    }
+    return size;
+  }
+
+  static void stat_times(struct stat const& st, header& h) {
+#ifdef __APPLE__
+    h.mtime_sec = st.st_mtimespec.tv_sec;
+    h.mtime_nsec = st.st_mtimespec.tv_nsec;
+#else
+    h.mtime_sec = st.st_mtim.tv_sec;
+    h.mtime_nsec = st.st_mtim.tv_nsec;
+#endif
+  }
+
+  // Calls f(block, trigram) once for every distinct trigram starting in
+  // each block, block by block. seen must hold trigram_space bits.
+  template <typename F>
+  static void for_each_trigram(char const* data, size_t len, uint32_t block_size,
+                               std::vector<uint64_t>& seen, F f) {
+    std::vector<uint32_t> touched;
+    for (size_t begin = 0; begin + 2 < len; begin += block_size) {
+      uint32_t block = static_cast<uint32_t>(begin / block_size);
+      size_t end = std::min(len - 2, begin + block_size);
+      for (size_t i = begin; i < end; i++) {
+        uint32_t t = trigram_at(data + i);
+        uint64_t bit = uint64_t(1) << (t % 64);
+        if ((seen[t / 64] & bit) == 0) {
+          seen[t / 64] |= bit;
+          touched.push_back(t);
+          f(block, t);
+        }
+      }
+      for (uint32_t t : touched) {
+        seen[t / 64] = 0;
+      }
+      touched.clear();
+    }
+  }
+
+  // A damaged entry yields every block, which is slow but still correct.
+  std::vector<uint32_t> postings(entry const& e) const {
+    std::vector<uint32_t> blocks;
+    if (e.offset > header_.postings_size || e.size > header_.postings_size - e.offset) {
+      uint64_t count = (header_.file_size + header_.block_size - 1) / header_.block_size;
+      for (uint64_t block = 0; block < count; block++) {
+        blocks.push_back(static_cast<uint32_t>(block));
+      }
+      return blocks;
+    }
+    unsigned char const* p = postings_ + e.offset;
+    unsigned char const* end = p + e.size;
+    uint32_t block = 0;
+    while (p != end) {
+      uint32_t delta = 0;
+      for (int shift = 0; p != end && shift < 32; shift += 7) {
+        delta |= uint32_t(*p & 0x7f) << shift;
+        if ((*p++ & 0x80) == 0) {
+          break;
+        }
+      }
+      block += delta;
+      blocks.push_back(block);
+    }
+    return blocks;
+  }
+};
+
+inline bool trigram_index::build(char const* path, uint32_t block_size) {
+  FILE* file = std::fopen(path, "r");
+  if (file == nullptr) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fileno(file), &st) != 0) {
+    std::fclose(file);
+    return false;
+  }
+  file_mapping mapping(file);
+  std::fclose(file);
+  if (!mapping.valid()) {
+    errno = EINVAL;
+    return false;
+  }
+  if (mapping.size() / block_size >= UINT32_MAX) {
+    errno = EFBIG;
+    return false;
+  }
+
+  // First pass: the postings size of every trigram. Second pass: the
+  // postings themselves, written straight into place.
+  std::vector<uint64_t> seen(trigram_space / 64, 0);
+  std::vector<uint32_t> last(trigram_space, 0);
+  std::vector<uint32_t> size(trigram_space, 0);
+  for_each_trigram(mapping.data(), mapping.size(), block_size, seen, [&](uint32_t block, uint32_t t) {
+    size[t] += static_cast<uint32_t>(varint_size(block - last[t]));
+    last[t] = block;
+  });
+
+  std::vector<entry> entries;
+  uint64_t postings_size = 0;
+  for (uint32_t t = 0; t < trigram_space; t++) {
+    if (size[t] != 0) {
+      entries.push_back({t, size[t], postings_size});
+      postings_size += size[t];
+      // from here on, size[] maps a trigram to its entry
+      size[t] = static_cast<uint32_t>(entries.size() - 1);
+    }
+  }
+  std::vector<unsigned char> postings(postings_size);
+  std::vector<uint64_t> cursor(entries.size());
+  for (size_t i = 0; i < entries.size(); i++) {
+    cursor[i] = entries[i].offset;
+  }
+  std::fill(last.begin(), last.end(), 0);
+  for_each_trigram(mapping.data(), mapping.size(), block_size, seen, [&](uint32_t block, uint32_t t) {
+    uint64_t& at = cursor[size[t]];
+    for (uint32_t delta = block - last[t];; delta >>= 7) {
+      postings[at++] = static_cast<unsigned char>(delta >= 0x80 ? (delta & 0x7f) | 0x80 : delta);
+      if (delta < 0x80) {
+        break;
+      }
+    }
+    last[t] = block;
+  });
+
+  header h{};
+  std::memcpy(h.magic, magic, sizeof(magic));
+  h.version = version;
+  h.block_size = block_size;
+  h.file_size = mapping.size();
+  stat_times(st, h);
+  h.entry_count = entries.size();
+  h.postings_size = postings_size;
+
+  // Written to a temporary file and renamed, so a reader never sees a
+  // partial index.
+  std::string target = path_for(path);
+  std::string tmp = target + ".tmp";
+  FILE* out = std::fopen(tmp.c_str(), "wb");
+  if (out == nullptr) {
+    return false;
+  }
+  bool ok = std::fwrite(&h, sizeof(h), 1, out) == 1 &&
+            std::fwrite(entries.data(), sizeof(entry), entries.size(), out) == entries.size() &&
+            std::fwrite(postings.data(), 1, postings.size(), out) == postings.size();
+  int error = errno;
+  ok &= std::fclose(out) == 0;
+  if (!ok || std::rename(tmp.c_str(), target.c_str()) != 0) {
+    error = ok ? errno : error;
+    std::remove(tmp.c_str());
+    errno = error;
+    return false;
+  }
+  return true;
+}
+
+inline trigram_index::trigram_index(char const* path, FILE* file) {
+  FILE* index = std::fopen(path_for(path).c_str(), "rb");
+  if (index == nullptr) {
+    return;
+  }
+  mapping_ = std::make_unique<file_mapping>(index);
+  std::fclose(index);
+  state_ = status::corrupt;
+  if (!mapping_->valid() || mapping_->size() < sizeof(header)) {
+    return;
+  }
+  std::memcpy(&header_, mapping_->data(), sizeof(header));
+  uint64_t body = mapping_->size() - sizeof(header);
+  if (std::memcmp(header_.magic, magic, sizeof(magic)) != 0 || header_.version != version ||
+      header_.block_size == 0 || header_.entry_count > body / sizeof(entry) ||
+      header_.postings_size != body - header_.entry_count * sizeof(entry)) {
+    return;
+  }
+  entries_ = reinterpret_cast<entry const*>(mapping_->data() + sizeof(header));
+  postings_ = reinterpret_cast<unsigned char const*>(entries_ + header_.entry_count);
+
+  struct stat st;
+  if (fstat(fileno(file), &st) != 0) {
+    return;
+  }
+  header now{};
+  stat_times(st, now);
+  state_ = static_cast<uint64_t>(st.st_size) == header_.file_size &&
+                   now.mtime_sec == header_.mtime_sec && now.mtime_nsec == header_.mtime_nsec
+               ? status::ok
+               : status::stale;
+}
+
+inline std::vector<uint32_t> trigram_index::candidates(std::string_view pattern) const {
+  // A match starting in block b has its trigrams in blocks b..b+reach.
+  uint32_t reach = static_cast<uint32_t>((header_.block_size + pattern.size() - 4) / header_.block_size);
+  std::vector<entry const*> used;
+  for (size_t i = 0; i + 2 < pattern.size(); i++) {
+    uint32_t t = trigram_at(pattern.data() + i);
+    entry const* end = entries_ + header_.entry_count;
+    entry const* e = std::lower_bound(entries_, end, t,
+                                      [](entry const& e, uint32_t t) { return e.trigram < t; });
+    if (e == end || e->trigram != t) {
+      return {};
+    }
+    used.push_back(e);
+  }
+  std::sort(used.begin(), used.end());
+  used.erase(std::unique(used.begin(), used.end()), used.end());
+  std::sort(used.begin(), used.end(),
+            [](entry const* a, entry const* b) { return a->size < b->size; });
+
+  // rarest trigram first, so the candidate set is small from the start
+  std::vector<uint32_t> result;
+  std::vector<uint32_t> shifted;
+  std::vector<uint32_t> both;
+  for (size_t k = 0; k < used.size(); k++) {
+    shifted.clear();
+    for (uint32_t block : postings(*used[k])) {
+      for (uint32_t s = 0; s <= reach && s <= block; s++) {
+        shifted.push_back(block - s);
+      }
+    }
+    std::sort(shifted.begin(), shifted.end());
+    shifted.erase(std::unique(shifted.begin(), shifted.end()), shifted.end());
+    if (k == 0) {
+      result.swap(shifted);
+    } else {
+      both.clear();
+      std::set_intersection(result.begin(), result.end(), shifted.begin(), shifted.end(),
+                            std::back_inserter(both));
+      result.swap(both);
+    }
+    if (result.empty()) {
+      break;
+    }
+  }
+  return result;
+}
+#endif
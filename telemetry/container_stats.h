@@ -0,0 +1,127 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Opt-in counters for container memory behaviour, enabled by defining
+// CONTAINER_TELEMETRY. Counters are aggregated over all instances of one
+// container type; without the macro every hook is an empty inline function
+// and snapshot() returns zeros.
+struct container_stats_snapshot {
+  uint64_t allocations = 0;
+  uint64_t bytes_allocated = 0;
+  uint64_t growth_copies = 0;
+  uint64_t growth_moves = 0;
+  uint64_t unshares = 0;
+  uint64_t unshare_bytes = 0;
+  // high-water marks, sampled whenever a buffer is (re)allocated or released
+  uint64_t peak_capacity_bytes = 0;
+  uint64_t peak_size_bytes = 0;
+  uint64_t peak_unused_bytes = 0;
+};
+
+// Each configuration lives in its own inline namespace, so translation
+// units built with and without the macro get distinct container_stats
+// types instead of two conflicting definitions of one.
+#ifdef CONTAINER_TELEMETRY
+inline namespace container_telemetry_on {
+#else
+inline namespace container_telemetry_off {
+#endif
+
+template <typename Container>
+struct container_stats {
+#ifdef CONTAINER_TELEMETRY
+  static constexpr bool enabled = true;
+#else
+  static constexpr bool enabled = false;
+#endif
+
+  static void on_allocation([[maybe_unused]] size_t bytes) {
+#ifdef CONTAINER_TELEMETRY
+    counters.allocations.fetch_add(1, std::memory_order_relaxed);
+    counters.bytes_allocated.fetch_add(bytes, std::memory_order_relaxed);
+#endif
+  }
+
+  // elements copy- or move-constructed into a new buffer during growth
+  static void on_growth([[maybe_unused]] size_t copies,
+                        [[maybe_unused]] size_t moves) {
+#ifdef CONTAINER_TELEMETRY
+    counters.growth_copies.fetch_add(copies, std::memory_order_relaxed);
+    counters.growth_moves.fetch_add(moves, std::memory_order_relaxed);
+#endif
+  }
+
+  static void on_unshare([[maybe_unused]] size_t bytes) {
+#ifdef CONTAINER_TELEMETRY
+    counters.unshares.fetch_add(1, std::memory_order_relaxed);
+    counters.unshare_bytes.fetch_add(bytes, std::memory_order_relaxed);
+#endif
+  }
+
+  static void on_capacity([[maybe_unused]] size_t size_bytes,
+                          [[maybe_unused]] size_t capacity_bytes) {
+#ifdef CONTAINER_TELEMETRY
+    update_max(counters.peak_capacity_bytes, capacity_bytes);
+    update_max(counters.peak_size_bytes, size_bytes);
+    update_max(counters.peak_unused_bytes, capacity_bytes - size_bytes);
+#endif
+  }
+
+  static container_stats_snapshot snapshot() {
+    container_stats_snapshot res;
+#ifdef CONTAINER_TELEMETRY
+    res.allocations = counters.allocations.load(std::memory_order_relaxed);
+    res.bytes_allocated = counters.bytes_allocated.load(std::memory_order_relaxed);
+    res.growth_copies = counters.growth_copies.load(std::memory_order_relaxed);
+    res.growth_moves = counters.growth_moves.load(std::memory_order_relaxed);
+    res.unshares = counters.unshares.load(std::memory_order_relaxed);
+    res.unshare_bytes = counters.unshare_bytes.load(std::memory_order_relaxed);
+    res.peak_capacity_bytes =
+        counters.peak_capacity_bytes.load(std::memory_order_relaxed);
+    res.peak_size_bytes = counters.peak_size_bytes.load(std::memory_order_relaxed);
+    res.peak_unused_bytes =
+        counters.peak_unused_bytes.load(std::memory_order_relaxed);
+#endif
+    return res;
+  }
+
+  static void reset() {
+#ifdef CONTAINER_TELEMETRY
+    for (auto* c : {&counters.allocations, &counters.bytes_allocated,
+                    &counters.growth_copies, &counters.growth_moves,
+                    &counters.unshares, &counters.unshare_bytes,
+                    &counters.peak_capacity_bytes, &counters.peak_size_bytes,
+                    &counters.peak_unused_bytes}) {
+      c->store(0, std::memory_order_relaxed);
+    }
+#endif
+  }
+
+private:
+#ifdef CONTAINER_TELEMETRY
+  struct atomic_counters {
+    std::atomic<uint64_t> allocations{0};
+    std::atomic<uint64_t> bytes_allocated{0};
+    std::atomic<uint64_t> growth_copies{0};
+    std::atomic<uint64_t> growth_moves{0};
+    std::atomic<uint64_t> unshares{0};
+    std::atomic<uint64_t> unshare_bytes{0};
+    std::atomic<uint64_t> peak_capacity_bytes{0};
+    std::atomic<uint64_t> peak_size_bytes{0};
+    std::atomic<uint64_t> peak_unused_bytes{0};
+  };
+
+  static inline atomic_counters counters;
+
+  static void update_max(std::atomic<uint64_t>& peak, uint64_t value) {
+    uint64_t cur = peak.load(std::memory_order_relaxed);
+    while (cur < value &&
+           !peak.compare_exchange_weak(cur, value, std::memory_order_relaxed)) {
+    }
+  }
+#endif
+};
+
+} // namespace container_telemetry_on or container_telemetry_off
@@ -0,0 +1,157 @@
+// Benchmark for the growth path of vector.h and segmented_vector.h:
+// push_back of n elements into an empty container, for vector,
+// segmented_vector and std::vector. Prints one tab-separated line per
+// configuration:
+//
+//   container element size seconds ns_per_push max_push_ns
+//
+// max_push_ns is the slowest single push_back, timed one by one in a
+// separate pass; it shows the pause of a reallocation, which
+// segmented_vector does not have.
+//
+// Element "u64" is trivially copyable, so growth is a memcpy. "string"
+// (32 bytes of text, beyond the small string buffer) has a noexcept move,
+// so growth moves it. "fragile" is the same string behind a move
+// constructor that may throw, so growth copies it to keep the strong
+// guarantee. Each timing is the best of --repeat runs.
+
+#include "segmented_vector.h"
+#include "vector.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+char const usage[] = "Error. Expected [--sizes <elements>,...] [--repeat <n>]";
+
+struct options {
+  std::vector<size_t> sizes = {size_t(1) << 10, size_t(1) << 16, size_t(1) << 20};
+  size_t repeat = 3;
+};
+
+bool parse_list(char const* s, std::vector<size_t>& values) {
+  values.clear();
+  for (;;) {
+    char* end;
+    unsigned long long v = std::strtoull(s, &end, 10);
+    if (end == s || v == 0) {
+      return false;
+    }
+    values.push_back(v);
+    if (*end == '\0') {
+      return true;
+    }
+    if (*end != ',') {
+      return false;
+    }
+    s = end + 1;
+  }
+}
+
+bool parse_options(int argc, char** argv, options& opt) {
+  std::vector<size_t> repeat;
+  for (int i = 1; i < argc; i++) {
+    bool ok = i + 1 < argc;
+    if (ok && std::strcmp(argv[i], "--sizes") == 0) {
+      ok = parse_list(argv[++i], opt.sizes);
+    } else if (ok && std::strcmp(argv[i], "--repeat") == 0) {
+      ok = parse_list(argv[++i], repeat) && repeat.size() == 1;
+      opt.repeat = ok ? repeat[0] : 0;
+    } else {
+      ok = false;
+    }
+    if (!ok) {
+      std::perror(usage);
+      return false;
+    }
+  }
+  return true;
+}
+
+struct fragile {
+  std::string text;
+
+  fragile(std::string const& text) : text(text) {}
+  fragile(fragile const&) = default;
+  fragile(fragile&& other) : text(std::move(other.text)) {}
+};
+
+// Keeps the compiler from dropping a container that is never read.
+template <typename T>
+void escape(T const& value) {
+  asm volatile("" : : "r"(&value) : "memory");
+}
+
+struct result {
+  double seconds;
+  double max_push_seconds;
+};
+
+// Best of `repeat` runs for both the total and the slowest push.
+template <typename Container, typename T>
+result run(T const& value, size_t size, size_t repeat) {
+  result best{1e100, 1e100};
+  for (size_t r = 0; r < repeat; r++) {
+    auto start = std::chrono::steady_clock::now();
+    {
+      Container c;
+      for (size_t i = 0; i < size; i++) {
+        c.push_back(value);
+      }
+      escape(c);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    best.seconds = std::min(best.seconds, seconds);
+
+    double slowest = 0;
+    {
+      Container c;
+      for (size_t i = 0; i < size; i++) {
+        auto before = std::chrono::steady_clock::now();
+        c.push_back(value);
+        auto after = std::chrono::steady_clock::now();
+        slowest = std::max(slowest, std::chrono::duration<double>(after - before).count());
+      }
+      escape(c);
+    }
+    best.max_push_seconds = std::min(best.max_push_seconds, slowest);
+  }
+  return best;
+}
+
+void report(char const* container, char const* element, size_t size, result r) {
+  std::printf("%s\t%s\t%zu\t%.6f\t%.2f\t%.0f\n", container, element, size, r.seconds,
+              r.seconds / size * 1e9, r.max_push_seconds * 1e9);
+  std::fflush(stdout);
+}
+
+template <typename T>
+void run_all(options const& opt, char const* element, T const& value) {
+  for (size_t size : opt.sizes) {
+    report("vector", element, size, run<vector<T>>(value, size, opt.repeat));
+    report("segmented_vector", element, size, run<segmented_vector<T>>(value, size, opt.repeat));
+    report("std::vector", element, size, run<std::vector<T>>(value, size, opt.repeat));
+  }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  options opt;
+  if (!parse_options(argc, argv, opt)) {
+    return -1;
+  }
+  std::string text(32, 'x');
+  std::printf("container\telement\tsize\tseconds\tns_per_push\tmax_push_ns\n");
+  run_all(opt, "u64", uint64_t(42));
+  run_all(opt, "string", text);
+  run_all(opt, "fragile", fragile(text));
+  return 0;
+}
@@ -0,0 +1,597 @@
+// Behaviour checks for vector.h: the strong exception guarantee of growth
+// and insertion, the bulk operations (range erase, assign, resize,
+// append_range, insert) against a throwing element type, the growth
+// counters, and how allocators propagate on copy, move and swap; for
+// mmap_allocator.h, reallocation across the mapping threshold; and for
+// segmented_vector.h, stable references and iterators across the
+// incremental directory growth. Prints every failed check and exits with a
+// non-zero status if any failed.
+
+// before vector.h, so the counters are live
+#define CONTAINER_TELEMETRY
+
+#include "memory_resource.h"
+#include "mmap_allocator.h"
+#include "segmented_vector.h"
+#include "vector.h"
+
+#include <cstdio>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+void check(bool ok, char const* what, int line) {
+  if (!ok) {
+    std::fprintf(stderr, "check.cpp:%d: check failed: %s\n", line, what);
+    failures++;
+  }
+}
+
+// Copies and moves spend a shared budget and throw once it is used up; a
+// negative budget is unlimited. The move constructor may throw, so vector
+// has to copy when it relocates elements.
+struct fragile {
+  static inline int copies_left = -1;
+  static inline int moves_left = -1;
+
+  int value;
+
+  fragile(int v) : value(v) {}
+
+  fragile(fragile const& other) : value(other.value) {
+    spend(copies_left);
+  }
+
+  fragile(fragile&& other) : value(other.value) {
+    spend(moves_left);
+    other.value = -1;
+  }
+
+  fragile& operator=(fragile const&) = default;
+  fragile& operator=(fragile&&) = default;
+
+  static void spend(int& budget) {
+    if (budget == 0) {
+      throw std::runtime_error("fragile");
+    }
+    if (budget > 0) {
+      budget--;
+    }
+  }
+
+  static void unlimited() {
+    copies_left = -1;
+    moves_left = -1;
+  }
+};
+
+static_assert(!std::is_nothrow_move_constructible_v<fragile>);
+
+// v holds 0, 1, ..., n - 1
+bool holds(vector<fragile> const& v, int n) {
+  if (v.size() != static_cast<size_t>(n)) {
+    return false;
+  }
+  for (int i = 0; i < n; i++) {
+    if (v[i].value != i) {
+      return false;
+    }
+  }
+  return true;
+}
+
+vector<fragile> full(int n) {
+  vector<fragile> v;
+  v.reserve(n);
+  for (int i = 0; i < n; i++) {
+    v.emplace_back(i);
+  }
+  return v;
+}
+
+void check_growth() {
+  {
+    // moves would throw on the third one, but growth copies
+    vector<fragile> v = full(4);
+    fragile extra(4);
+    fragile::moves_left = 2;
+    v.push_back(extra);
+    fragile::unlimited();
+    CHECK(holds(v, 5));
+  }
+  {
+    vector<fragile> v = full(4);
+    fragile const* data = v.data();
+    fragile extra(4);
+    fragile::moves_left = 2;
+    fragile::copies_left = 2;
+    bool threw = false;
+    try {
+      v.push_back(extra);
+    } catch (std::runtime_error const&) {
+      threw = true;
+    }
+    fragile::unlimited();
+    CHECK(threw);
+    CHECK(holds(v, 4));
+    CHECK(v.data() == data);
+    CHECK(v.capacity() == 4);
+  }
+  {
+    vector<fragile> v = full(4);
+    fragile::copies_left = 1;
+    bool threw = false;
+    try {
+      v.reserve(16);
+    } catch (std::runtime_error const&) {
+      threw = true;
+    }
+    fragile::unlimited();
+    CHECK(threw);
+    CHECK(holds(v, 4));
+    CHECK(v.capacity() == 4);
+  }
+  {
+    // an element of the vector itself, pushed while it reallocates
+    vector<fragile> v = full(4);
+    v.push_back(v[2]);
+    CHECK(v.size() == 5 && v[4].value == 2);
+  }
+}
+
+void check_insert() {
+  {
+    vector<fragile> v = full(6);
+    v.reserve(8);
+    fragile extra(-2);
+    fragile::copies_left = 3;
+    bool threw = false;
+    try {
+      v.insert(v.begin() + 2, 2, extra);
+    } catch (std::runtime_error const&) {
+      threw = true;
+    }
+    fragile::unlimited();
+    CHECK(threw);
+    CHECK(holds(v, 6));
+  }
+  {
+    // one move for the new element; the old ones are copied
+    vector<fragile> v = full(6);
+    fragile extra(-2);
+    fragile::moves_left = 1;
+    v.insert(v.begin() + 2, std::move(extra));
+    fragile::unlimited();
+    CHECK(v.size() == 7 && v[2].value == -2 && v[3].value == 2 && v[6].value == 5);
+  }
+}
+
+// Counts live objects, so a leaked or doubly destroyed element shows up.
+// Copies spend a budget as fragile's do, but the move is noexcept, so
+// insertions within the capacity shift the tail in place.
+struct tracked {
+  static inline int live = 0;
+  static inline int copies_left = -1;
+
+  int value;
+
+  tracked(int v = 0) : value(v) {
+    live++;
+  }
+
+  tracked(tracked const& other) : value(other.value) {
+    fragile::spend(copies_left);
+    live++;
+  }
+
+  tracked(tracked&& other) noexcept : value(other.value) {
+    live++;
+  }
+
+  tracked& operator=(tracked const&) = default;
+  tracked& operator=(tracked&&) = default;
+
+  ~tracked() {
+    live--;
+  }
+};
+
+std::vector<int> values(vector<tracked> const& v) {
+  std::vector<int> res;
+  for (tracked const& t : v) {
+    res.push_back(t.value);
+  }
+  return res;
+}
+
+vector<tracked> tracked_numbers(int n) {
+  vector<tracked> v;
+  for (int i = 0; i < n; i++) {
+    v.emplace_back(i);
+  }
+  return v;
+}
+
+// Runs f with `copies` copies allowed and reports whether it threw.
+template <typename F>
+bool throws_after(int copies, F f) {
+  tracked::copies_left = copies;
+  bool threw = false;
+  try {
+    f();
+  } catch (std::runtime_error const&) {
+    threw = true;
+  }
+  tracked::copies_left = -1;
+  return threw;
+}
+
+void check_bulk() {
+  using list = std::vector<int>;
+  {
+    vector<tracked> v = tracked_numbers(8);
+    CHECK(v.erase(v.begin() + 2, v.begin() + 5) == v.begin() + 2);
+    CHECK(values(v) == list({0, 1, 5, 6, 7}));
+    CHECK(v.erase(v.begin() + 3, v.end()) == v.end());
+    CHECK(v.erase(v.begin() + 1, v.begin() + 1) == v.begin() + 1);
+    CHECK(values(v) == list({0, 1, 5}) && tracked::live == 3);
+  }
+  {
+    vector<tracked> v = tracked_numbers(6);
+    v.reserve(10);
+    tracked const* data = v.data();
+    v.assign(3, tracked(9));
+    CHECK(values(v) == list({9, 9, 9}) && v.data() == data);
+    v.assign(8, tracked(4));
+    CHECK(values(v) == list(8, 4) && v.data() == data && tracked::live == 8);
+    // beyond the capacity, assign builds a new buffer first
+    CHECK(throws_after(5, [&] { v.assign(12, tracked(1)); }));
+    CHECK(values(v) == list(8, 4) && v.data() == data && tracked::live == 8);
+    v.assign(12, tracked(1));
+    CHECK(values(v) == list(12, 1) && tracked::live == 12);
+  }
+  {
+    vector<tracked> v = tracked_numbers(4);
+    std::list<int> numbers = {7, 8};
+    v.assign(numbers.begin(), numbers.end());
+    CHECK(values(v) == list({7, 8}) && tracked::live == 2);
+    std::vector<tracked> source(20, tracked(3));
+    CHECK(throws_after(10, [&] { v.assign(source.begin(), source.end()); }));
+    CHECK(values(v) == list({7, 8}) && tracked::live == 2 + 20);
+  }
+  {
+    // an input range is read once, element by element
+    vector<int> v;
+    std::istringstream in("1 2 3 4 5");
+    v.assign(std::istream_iterator<int>(in), std::istream_iterator<int>());
+    CHECK(v.size() == 5 && v[0] == 1 && v[4] == 5);
+    std::istringstream more("6 7");
+    v.insert(v.begin() + 1, std::istream_iterator<int>(more), std::istream_iterator<int>());
+    CHECK(v.size() == 7 && v[1] == 6 && v[2] == 7 && v[3] == 2);
+  }
+  {
+    vector<tracked> v = tracked_numbers(5);
+    v.resize(8);
+    CHECK(values(v) == list({0, 1, 2, 3, 4, 0, 0, 0}));
+    v.resize(2);
+    CHECK(values(v) == list({0, 1}) && tracked::live == 2);
+    v.reserve(8);
+    CHECK(throws_after(3, [&] { v.resize(8, tracked(6)); }));
+    CHECK(values(v) == list({0, 1}) && tracked::live == 2);
+    v.resize(4, tracked(6));
+    CHECK(values(v) == list({0, 1, 6, 6}) && tracked::live == 4);
+  }
+  {
+    vector<tracked> v = tracked_numbers(3);
+    v.append_range(std::list<tracked>{tracked(3), tracked(4)});
+    CHECK(values(v) == list({0, 1, 2, 3, 4}));
+    // from itself, with and without reallocating
+    v.append_range(v);
+    CHECK(values(v) == list({0, 1, 2, 3, 4, 0, 1, 2, 3, 4}));
+    v.reserve(32);
+    v.append_range(v);
+    CHECK(v.size() == 20 && v[19].value == 4 && tracked::live == 20);
+  }
+  {
+    // a copy throwing part-way through an insertion within the capacity
+    // shifts the tail back
+    vector<tracked> v = tracked_numbers(6);
+    v.reserve(12);
+    tracked const* data = v.data();
+    std::vector<tracked> source = {tracked(7), tracked(8), tracked(9)};
+    CHECK(throws_after(2, [&] { v.insert(v.begin() + 2, source.begin(), source.end()); }));
+    CHECK(values(v) == list({0, 1, 2, 3, 4, 5}) && v.data() == data && tracked::live == 6 + 3);
+    v.insert(v.begin() + 2, source.begin(), source.end());
+    CHECK(values(v) == list({0, 1, 7, 8, 9, 2, 3, 4, 5}) && v.data() == data);
+    // and one that needs a new buffer leaves the old one alone
+    CHECK(throws_after(3, [&] { v.insert(v.begin() + 1, 4, tracked(-1)); }));
+    CHECK(values(v) == list({0, 1, 7, 8, 9, 2, 3, 4, 5}) && v.data() == data);
+    v.insert(v.begin() + 1, 4, v[8]);
+    CHECK(values(v) == list({0, 5, 5, 5, 5, 1, 7, 8, 9, 2, 3, 4, 5}));
+  }
+  CHECK(tracked::live == 0);
+}
+
+// Growth reports a copy or a move for each element it relocates, matching
+// what it actually did.
+template <typename T>
+void check_growth_counters(T const& value, bool moves) {
+  vector<T> v;
+  v.reserve(4);
+  for (int i = 0; i < 4; i++) {
+    v.push_back(value);
+  }
+  vector<T>::stats::reset();
+  v.reserve(8);
+  container_stats_snapshot s = vector<T>::stats::snapshot();
+  CHECK(s.growth_copies == (moves ? 0 : 4));
+  CHECK(s.growth_moves == (moves ? 4 : 0));
+}
+
+void check_counters() {
+  check_growth_counters(fragile(1), false);
+  check_growth_counters(std::string(100, 'x'), true);
+  check_growth_counters(0, true);
+
+  // not copyable, so moved even though the move may throw
+  struct move_only {
+    std::unique_ptr<int> p;
+    move_only() = default;
+    move_only(move_only&& other) noexcept(false) : p(std::move(other.p)) {}
+  };
+  vector<move_only> v;
+  v.emplace_back();
+  vector<move_only>::stats::reset();
+  v.reserve(2);
+  CHECK(vector<move_only>::stats::snapshot().growth_moves == 1);
+}
+
+// Allocations per allocator id, so a buffer freed through an allocator
+// that did not allocate it shows up as an imbalance.
+long outstanding[4];
+
+template <typename T, bool Propagate>
+struct tagged_allocator {
+  using value_type = T;
+  using propagate_on_container_copy_assignment = std::bool_constant<Propagate>;
+  using propagate_on_container_move_assignment = std::bool_constant<Propagate>;
+  using propagate_on_container_swap = std::bool_constant<Propagate>;
+  using is_always_equal = std::false_type;
+
+  int id;
+
+  explicit tagged_allocator(int id) : id(id) {}
+
+  template <typename U>
+  tagged_allocator(tagged_allocator<U, Propagate> const& other) : id(other.id) {}
+
+  T* allocate(size_t n) {
+    outstanding[id] += n;
+    return std::allocator<T>().allocate(n);
+  }
+
+  void deallocate(T* p, size_t n) {
+    outstanding[id] -= n;
+    std::allocator<T>().deallocate(p, n);
+  }
+
+  friend bool operator==(tagged_allocator const& a, tagged_allocator const& b) {
+    return a.id == b.id;
+  }
+};
+
+template <bool Propagate>
+using tagged_vector = vector<int, tagged_allocator<int, Propagate>>;
+
+template <bool Propagate>
+tagged_vector<Propagate> numbers(int id, int n) {
+  tagged_vector<Propagate> v{tagged_allocator<int, Propagate>(id)};
+  for (int i = 0; i < n; i++) {
+    v.push_back(i);
+  }
+  return v;
+}
+
+template <bool Propagate>
+void check_propagation() {
+  using vec = tagged_vector<Propagate>;
+  {
+    vec a = numbers<Propagate>(1, 5);
+    vec b(a);
+    CHECK(b.get_allocator().id == 1 && b.size() == 5 && b[4] == 4);
+    vec c(std::move(a), tagged_allocator<int, Propagate>(2));
+    CHECK(c.get_allocator().id == 2 && c.size() == 5 && c[4] == 4);
+  }
+  {
+    vec a = numbers<Propagate>(1, 3);
+    vec b = numbers<Propagate>(2, 7);
+    a = b;
+    CHECK(a.get_allocator().id == (Propagate ? 2 : 1));
+    CHECK(a.size() == 7 && a[6] == 6);
+  }
+  {
+    vec a = numbers<Propagate>(1, 3);
+    vec b = numbers<Propagate>(2, 7);
+    int const* data = b.data();
+    a = std::move(b);
+    CHECK(a.get_allocator().id == (Propagate ? 2 : 1));
+    CHECK(a.size() == 7 && a[6] == 6);
+    // only a propagating allocator lets the buffer change hands
+    CHECK((a.data() == data) == Propagate);
+  }
+  {
+    vec a = numbers<Propagate>(1, 3);
+    vec b = numbers<Propagate>(Propagate ? 2 : 1, 7);
+    a.swap(b);
+    CHECK(a.size() == 7 && b.size() == 3);
+    CHECK(a.get_allocator().id == (Propagate ? 2 : 1));
+  }
+  for (long n : outstanding) {
+    CHECK(n == 0);
+  }
+}
+
+void check_pmr() {
+  bump_arena arena;
+  pmr::vector<int> v(&arena);
+  for (int i = 0; i < 100; i++) {
+    v.push_back(i);
+  }
+  CHECK(v.get_allocator().resource() == &arena);
+  // polymorphic_allocator does not propagate on copy
+  pmr::vector<int> copy(v);
+  CHECK(copy.get_allocator().resource() == std::pmr::get_default_resource());
+  CHECK(copy.size() == 100 && copy[99] == 99);
+}
+
+// Mapped from 4 KiB, so a thousand ints cross the threshold.
+using mapped_vector = vector<int, mmap_allocator<int, 4096>>;
+
+bool counts_up(mapped_vector const& v, int n) {
+  if (v.size() != static_cast<size_t>(n)) {
+    return false;
+  }
+  for (int i = 0; i < n; i++) {
+    if (v[i] != i) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void check_mmap() {
+  {
+    // reallocate keeps the live elements in place, within operator new
+    // buffers, across the threshold both ways and between mappings
+    mmap_allocator<int, 4096> a;
+    int* p = a.allocate(8);
+    for (int i = 0; i < 5; i++) {
+      p[i] = i;
+    }
+    bool kept = true;
+    size_t old_n = 8;
+    for (size_t n : {16, 2048, 8192, 512, 5}) {
+      p = a.reallocate(p, old_n, n, 5);
+      old_n = n;
+      for (int i = 0; i < 5; i++) {
+        kept &= p[i] == i;
+      }
+    }
+    CHECK(kept);
+    a.deallocate(p, 5);
+  }
+
+  mapped_vector v;
+  mapped_vector::stats::reset();
+  for (int i = 0; i < 5000; i++) {
+    v.push_back(i);
+  }
+  CHECK(counts_up(v, 5000));
+  // every growth went through reallocate, which moves no element itself
+  CHECK(mapped_vector::stats::snapshot().growth_moves == 0);
+
+  mapped_vector copy(v);
+  CHECK(counts_up(copy, 5000) && copy.data() != v.data());
+  mapped_vector moved(std::move(copy));
+  CHECK(counts_up(moved, 5000) && copy.empty());
+  copy = moved;
+  CHECK(counts_up(copy, 5000));
+
+  // shrinking within the mapping, then below the threshold
+  for (int i = 0; i < 3000; i++) {
+    v.pop_back();
+  }
+  v.shrink_to_fit();
+  CHECK(counts_up(v, 2000) && v.capacity() == 2000);
+  v.erase(v.begin() + 100, v.end());
+  v.shrink_to_fit();
+  CHECK(counts_up(v, 100) && v.capacity() == 100);
+  v.insert(v.end(), 4000, 7);
+  CHECK(v.size() == 4100 && v[99] == 99 && v[100] == 7 && v[4099] == 7);
+  v.clear();
+  v.shrink_to_fit();
+  CHECK(v.capacity() == 0);
+}
+
+void check_segmented() {
+  segmented_vector<std::string, 4> v;
+  std::vector<std::string const*> addresses;
+  std::vector<segmented_vector<std::string, 4>::iterator> iterators;
+  // enough chunks for several directory switches
+  for (int i = 0; i < 1000; i++) {
+    addresses.push_back(&v.emplace_back(std::to_string(i)));
+    iterators.push_back(v.end() - 1);
+  }
+  bool stable = true;
+  for (int i = 0; i < 1000; i++) {
+    stable &= &v[i] == addresses[i] && v[i] == std::to_string(i);
+    stable &= &*iterators[i] == addresses[i] && iterators[i] - v.begin() == i;
+  }
+  CHECK(stable);
+  // an iterator and a reference taken before the switches, used after them
+  segmented_vector<std::string, 4> w;
+  w.push_back("first");
+  segmented_vector<std::string, 4>::const_iterator first = w.begin();
+  std::string const& front = w.front();
+  for (int i = 1; i < 1000; i++) {
+    w.push_back(std::to_string(i));
+  }
+  CHECK(*first == "first" && &*first == &front && first[999] == "999");
+  CHECK(v.chunk_count() == 250 && v.chunk(249).size() == 4);
+
+  // shrinking while the next directory is being filled
+  for (int i = 0; i < 600; i++) {
+    v.pop_back();
+  }
+  v.shrink_to_fit();
+  CHECK(v.capacity() == 400);
+  for (int i = 400; i < 2000; i++) {
+    v.push_back(std::to_string(i));
+  }
+  bool values = true;
+  for (int i = 0; i < 2000; i++) {
+    values &= v[i] == std::to_string(i);
+  }
+  CHECK(values);
+
+  segmented_vector<std::string, 4> copy(v);
+  segmented_vector<std::string, 4> moved(std::move(v));
+  CHECK(v.empty() && copy.size() == 2000 && moved.size() == 2000);
+  CHECK(copy[1999] == "1999" && moved[1999] == "1999" && &copy[0] != &moved[0]);
+  int counted = 0;
+  for (std::string const& s : moved) {
+    counted += s == std::to_string(counted);
+  }
+  CHECK(counted == 2000);
+}
+
+} // namespace
+
+int main() {
+  check_growth();
+  check_insert();
+  check_bulk();
+  check_counters();
+  check_propagation<false>();
+  check_propagation<true>();
+  check_pmr();
+  check_mmap();
+  check_segmented();
+  if (failures != 0) {
+    std::fprintf(stderr, "%d checks failed\n", failures);
+    return -1;
+  }
+  std::printf("all checks passed\n");
+  return 0;
+}
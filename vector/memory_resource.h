@@ -0,0 +1,174 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+
+// Monotonic bump allocator: deallocate is a no-op and everything is freed
+// at once by release() or the destructor. Meant for per-request vectors.
+struct bump_arena : std::pmr::memory_resource {
+  explicit bump_arena(
+      size_t chunk_size = 64 * 1024,
+      std::pmr::memory_resource* upstream = std::pmr::new_delete_resource())
+      : upstream_(upstream), chunk_size_(chunk_size) {}
+
+  // The first allocations are served from a caller-provided buffer,
+  // e.g. one on the stack.
+  bump_arena(void* buffer, size_t size, size_t chunk_size = 64 * 1024,
+             std::pmr::memory_resource* upstream = std::pmr::new_delete_resource())
+      : upstream_(upstream), chunk_size_(chunk_size),
+        cur_(static_cast<std::byte*>(buffer)),
+        end_(static_cast<std::byte*>(buffer) + size),
+        initial_(static_cast<std::byte*>(buffer)), initial_size_(size) {}
+
+  bump_arena(bump_arena const&) = delete;
+  bump_arena& operator=(bump_arena const&) = delete;
+
+  ~bump_arena() override {
+    release();
+  }
+
+  void release() {
+    while (chunks_ != nullptr) {
+      chunk* next = chunks_->next;
+      upstream_->deallocate(chunks_, chunks_->size, alignof(chunk));
+      chunks_ = next;
+    }
+    cur_ = initial_;
+    end_ = initial_ + initial_size_;
+  }
+
+private:
+  struct chunk {
+    chunk* next;
+    size_t size;
+  };
+
+  std::pmr::memory_resource* upstream_;
+  size_t chunk_size_;
+  chunk* chunks_ = nullptr;
+  std::byte* cur_ = nullptr;
+  std::byte* end_ = nullptr;
+  std::byte* initial_ = nullptr;
+  size_t initial_size_ = 0;
+
+  void* do_allocate(size_t bytes, size_t alignment) override {
+    void* p = cur_;
+    size_t space = end_ - cur_;
+    if (cur_ == nullptr || std::align(alignment, bytes, p, space) == nullptr) {
+      size_t size = std::max(chunk_size_, sizeof(chunk) + bytes + alignment);
+      chunk* c = static_cast<chunk*>(upstream_->allocate(size, alignof(chunk)));
+      c->next = chunks_;
+      c->size = size;
+      chunks_ = c;
+      p = c + 1;
+      space = size - sizeof(chunk);
+      std::align(alignment, bytes, p, space);
+    }
+    cur_ = static_cast<std::byte*>(p) + bytes;
+    end_ = cur_ + (space - bytes);
+    return p;
+  }
+
+  void do_deallocate(void*, size_t, size_t) override {}
+
+  bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override {
+    return this == &other;
+  }
+};
+
+// Free-list pool of equally sized blocks. Requests that do not fit a block
+// are forwarded to the upstream resource.
+struct fixed_pool : std::pmr::memory_resource {
+  explicit fixed_pool(
+      size_t block_size, size_t blocks_per_chunk = 256,
+      std::pmr::memory_resource* upstream = std::pmr::new_delete_resource())
+      : upstream_(upstream),
+        block_size_(round_up(std::max(block_size, sizeof(node)))),
+        blocks_per_chunk_(std::max<size_t>(blocks_per_chunk, 1)) {}
+
+  fixed_pool(fixed_pool const&) = delete;
+  fixed_pool& operator=(fixed_pool const&) = delete;
+
+  ~fixed_pool() override {
+    release();
+  }
+
+  void release() {
+    while (chunks_ != nullptr) {
+      node* next = chunks_->next;
+      upstream_->deallocate(chunks_, chunk_bytes(), alignof(std::max_align_t));
+      chunks_ = next;
+    }
+    free_ = nullptr;
+  }
+
+  size_t block_size() const {
+    return block_size_;
+  }
+
+private:
+  struct node {
+    node* next;
+  };
+
+  std::pmr::memory_resource* upstream_;
+  size_t block_size_;
+  size_t blocks_per_chunk_;
+  node* chunks_ = nullptr;
+  node* free_ = nullptr;
+
+  static size_t round_up(size_t n) {
+    size_t a = alignof(std::max_align_t);
+    return (n + a - 1) / a * a;
+  }
+
+  size_t chunk_bytes() const {
+    return block_size_ * (blocks_per_chunk_ + 1);
+  }
+
+  bool fits(size_t bytes, size_t alignment) const {
+    return bytes <= block_size_ && alignment <= alignof(std::max_align_t);
+  }
+
+  // The first block of every chunk links the chunks together.
+  void grow() {
+    std::byte* mem = static_cast<std::byte*>(
+        upstream_->allocate(chunk_bytes(), alignof(std::max_align_t)));
+    node* head = reinterpret_cast<node*>(mem);
+    head->next = chunks_;
+    chunks_ = head;
+    for (size_t i = blocks_per_chunk_; i > 0; i--) {
+      node* block = reinterpret_cast<node*>(mem + i * block_size_);
+      block->next = free_;
+      free_ = block;
+    }
+  }
+
+  void* do_allocate(size_t bytes, size_t alignment) override {
+    if (!fits(bytes, alignment)) {
+      return upstream_->allocate(bytes, alignment);
+    }
+    if (free_ == nullptr) {
+      grow();
+    }
+    node* block = free_;
+    free_ = block->next;
+    return block;
+  }
+
+  void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+    if (!fits(bytes, alignment)) {
+      upstream_->deallocate(p, bytes, alignment);
+      return;
+    }
+    node* block = static_cast<node*>(p);
+    block->next = free_;
+    free_ = block;
+  }
+
+  bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override {
+    return this == &other;
+  }
+};
@@ -0,0 +1,109 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Allocator for huge vectors of trivially copyable elements. Buffers of at
+// least ThresholdBytes are anonymous mappings that vector grows and shrinks
+// in place through reallocate() (mremap on Linux), so a doubling neither
+// copies the data nor keeps two copies resident. Smaller buffers come from
+// operator new.
+template <typename T, size_t ThresholdBytes = (size_t(1) << 24)>
+struct mmap_allocator {
+  using value_type = T;
+  using is_always_equal = std::true_type;
+
+  template <typename U>
+  struct rebind {
+    using other = mmap_allocator<U, ThresholdBytes>;
+  };
+
+  mmap_allocator() = default;
+
+  template <typename U>
+  mmap_allocator(mmap_allocator<U, ThresholdBytes> const&) noexcept {}
+
+  T* allocate(size_t n) {
+#ifdef __linux__
+    if (is_mapped(n)) {
+      void* p = mmap(nullptr, mapped_bytes(n), PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (p == MAP_FAILED) {
+        throw std::bad_alloc();
+      }
+      advise(p, mapped_bytes(n));
+      return static_cast<T*>(p);
+    }
+#endif
+    return static_cast<T*>(operator new(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, size_t n) noexcept {
+#ifdef __linux__
+    if (is_mapped(n)) {
+      munmap(p, mapped_bytes(n));
+      return;
+    }
+#endif
+    operator delete(p);
+  }
+
+  // Resizes the buffer of old_n elements to new_n elements, keeping the
+  // first `live` of them, which must be at most min(old_n, new_n); the
+  // rest is uninitialised. Only valid for trivially copyable T.
+  T* reallocate(T* p, size_t old_n, size_t new_n, size_t live) {
+    static_assert(std::is_trivially_copyable_v<T>);
+#ifdef __linux__
+    if (p != nullptr && is_mapped(old_n) && is_mapped(new_n)) {
+      void* res = mremap(p, mapped_bytes(old_n), mapped_bytes(new_n),
+                         MREMAP_MAYMOVE);
+      if (res == MAP_FAILED) {
+        throw std::bad_alloc();
+      }
+      if (new_n > old_n) {
+        advise(res, mapped_bytes(new_n));
+      }
+      return static_cast<T*>(res);
+    }
+#endif
+    T* res = allocate(new_n);
+    if (p != nullptr) {
+      std::copy_n(p, live, res);
+      deallocate(p, old_n);
+    }
+    return res;
+  }
+
+  friend bool operator==(mmap_allocator const&, mmap_allocator const&) {
+    return true;
+  }
+
+private:
+  static bool is_mapped(size_t n) {
+#ifdef __linux__
+    return n * sizeof(T) >= ThresholdBytes;
+#else
+    return false;
+#endif
+  }
+
+#ifdef __linux__
+  static size_t mapped_bytes(size_t n) {
+    static const size_t page = sysconf(_SC_PAGESIZE);
+    return (n * sizeof(T) + page - 1) / page * page;
+  }
+
+  static void advise(void* p, size_t bytes) {
+#ifdef MADV_HUGEPAGE
+    madvise(p, bytes, MADV_HUGEPAGE);
+#endif
+    madvise(p, bytes, MADV_SEQUENTIAL);
+  }
+#endif
+};
@@ -0,0 +1,361 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <iterator>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <utility>
+
+// Sequence of fixed-size chunks indexed through a directory of pointers.
+// Elements are never moved after construction, so references stay valid
+// until the element is removed, and growth never copies elements. The
+// directory, one pointer per chunk, grows without a copying pause: once it
+// is half full a twice larger one is allocated, and every new chunk copies
+// two old pointers into it, so it is complete by the time the old one
+// fills up. push_back is therefore O(1) in the worst case, not amortized.
+// Iterators are positions in the container rather than pointers into the
+// directory, so they also stay valid across push_back; after a swap they
+// keep referring to the same container.
+template <typename T,
+          size_t ChunkSize = std::bit_floor(std::max<size_t>(1, 4096 / sizeof(T)))>
+struct segmented_vector {
+  static_assert(std::has_single_bit(ChunkSize), "ChunkSize must be a power of two");
+
+private:
+  template <bool Const>
+  struct basic_iterator {
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = std::conditional_t<Const, T const*, T*>;
+    using reference = std::conditional_t<Const, T const&, T&>;
+
+    basic_iterator() = default;
+
+    operator basic_iterator<true>() const {
+      return {vec_, pos_};
+    }
+
+    reference operator*() const {
+      return (*vec_)[pos_];
+    }
+    pointer operator->() const {
+      return &**this;
+    }
+    reference operator[](difference_type n) const {
+      return *(*this + n);
+    }
+
+    basic_iterator& operator++() {
+      ++pos_;
+      return *this;
+    }
+    basic_iterator operator++(int) {
+      basic_iterator res = *this;
+      ++pos_;
+      return res;
+    }
+    basic_iterator& operator--() {
+      --pos_;
+      return *this;
+    }
+    basic_iterator operator--(int) {
+      basic_iterator res = *this;
+      --pos_;
+      return res;
+    }
+    basic_iterator& operator+=(difference_type n) {
+      pos_ += n;
+      return *this;
+    }
+    basic_iterator& operator-=(difference_type n) {
+      pos_ -= n;
+      return *this;
+    }
+
+    friend basic_iterator operator+(basic_iterator it, difference_type n) {
+      return it += n;
+    }
+    friend basic_iterator operator+(difference_type n, basic_iterator it) {
+      return it += n;
+    }
+    friend basic_iterator operator-(basic_iterator it, difference_type n) {
+      return it -= n;
+    }
+    friend difference_type operator-(basic_iterator const& a, basic_iterator const& b) {
+      return static_cast<difference_type>(a.pos_) - static_cast<difference_type>(b.pos_);
+    }
+    friend bool operator==(basic_iterator const& a, basic_iterator const& b) {
+      return a.pos_ == b.pos_;
+    }
+    friend auto operator<=>(basic_iterator const& a, basic_iterator const& b) {
+      return a.pos_ <=> b.pos_;
+    }
+
+  private:
+    friend segmented_vector;
+    template <bool>
+    friend struct basic_iterator;
+
+    using container = std::conditional_t<Const, segmented_vector const, segmented_vector>;
+
+    basic_iterator(container* vec, size_t pos) : vec_(vec), pos_(pos) {}
+
+    // not the directory, which add_chunk replaces as the vector grows
+    container* vec_ = nullptr;
+    size_t pos_ = 0;
+  };
+
+public:
+  using iterator = basic_iterator<false>;
+  using const_iterator = basic_iterator<true>;
+
+  static constexpr size_t chunk_size = ChunkSize;
+
+  // O(1) nothrow
+  segmented_vector() = default;
+
+  // O(N) strong
+  segmented_vector(segmented_vector const& other) {
+    try {
+      reserve(other.size());
+      for (T const& element : other) {
+        push_back(element);
+      }
+    } catch (...) {
+      release();
+      throw;
+    }
+  }
+
+  // O(1) nothrow
+  segmented_vector(segmented_vector&& other) noexcept {
+    swap(other);
+  }
+
+  // O(N) strong
+  segmented_vector& operator=(segmented_vector const& other) {
+    if (this != &other) {
+      segmented_vector(other).swap(*this);
+    }
+    return *this;
+  }
+
+  // O(N) nothrow
+  segmented_vector& operator=(segmented_vector&& other) noexcept {
+    if (this != &other) {
+      segmented_vector(std::move(other)).swap(*this);
+    }
+    return *this;
+  }
+
+  // O(N) nothrow
+  ~segmented_vector() {
+    release();
+  }
+
+  // O(1) nothrow
+  T& operator[](size_t i) {
+    return chunks_[i / ChunkSize][i % ChunkSize];
+  }
+
+  // O(1) nothrow
+  T const& operator[](size_t i) const {
+    return chunks_[i / ChunkSize][i % ChunkSize];
+  }
+
+  // O(1) nothrow
+  size_t size() const {
+    return size_;
+  }
+
+  // O(1) nothrow
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  // O(1) nothrow
+  size_t capacity() const {
+    return allocated_ * ChunkSize;
+  }
+
+  // O(1) nothrow
+  T& front() {
+    return (*this)[0];
+  }
+
+  // O(1) nothrow
+  T const& front() const {
+    return (*this)[0];
+  }
+
+  // O(1) nothrow
+  T& back() {
+    return (*this)[size_ - 1];
+  }
+
+  // O(1) nothrow
+  T const& back() const {
+    return (*this)[size_ - 1];
+  }
+
+  // O(1) strong
+  void push_back(T const& element) {
+    emplace_back(element);
+  }
+
+  // O(1) strong
+  void push_back(T&& element) {
+    emplace_back(std::move(element));
+  }
+
+  // O(1) strong
+  template <typename... Args>
+  T& emplace_back(Args&&... args) {
+    if (size_ == capacity()) {
+      add_chunk();
+    }
+    T* slot = &(*this)[size_];
+    new (slot) T(std::forward<Args>(args)...);
+    size_++;
+    return *slot;
+  }
+
+  // O(1) nothrow
+  void pop_back() {
+    back().~T();
+    size_--;
+  }
+
+  // O(N) nothrow; keeps the chunks for reuse
+  void clear() {
+    if constexpr (!std::is_trivially_destructible_v<T>) {
+      for (size_t i = size_; i > 0; i--) {
+        (*this)[i - 1].~T();
+      }
+    }
+    size_ = 0;
+  }
+
+  // O(new_cap / ChunkSize) strong
+  void reserve(size_t new_cap) {
+    while (capacity() < new_cap) {
+      add_chunk();
+    }
+  }
+
+  // O(chunks) nothrow
+  void shrink_to_fit() {
+    size_t used = (size_ + ChunkSize - 1) / ChunkSize;
+    for (; allocated_ > used; allocated_--) {
+      operator delete(chunks_[allocated_ - 1]);
+    }
+    copied_ = std::min(copied_, allocated_);
+  }
+
+  // O(1) nothrow
+  void swap(segmented_vector& other) {
+    std::swap(chunks_, other.chunks_);
+    std::swap(slots_, other.slots_);
+    std::swap(allocated_, other.allocated_);
+    std::swap(next_chunks_, other.next_chunks_);
+    std::swap(copied_, other.copied_);
+    std::swap(size_, other.size_);
+  }
+
+  // O(1) nothrow
+  size_t chunk_count() const {
+    return (size_ + ChunkSize - 1) / ChunkSize;
+  }
+
+  // O(1) nothrow: contiguous elements of the i-th chunk, the last one may
+  // be partially filled. Meant for vectorized or per-thread processing.
+  std::span<T> chunk(size_t i) {
+    return {chunks_[i], chunk_length(i)};
+  }
+
+  // O(1) nothrow
+  std::span<T const> chunk(size_t i) const {
+    return {chunks_[i], chunk_length(i)};
+  }
+
+  // O(1) nothrow
+  iterator begin() {
+    return {this, 0};
+  }
+
+  // O(1) nothrow
+  iterator end() {
+    return {this, size_};
+  }
+
+  // O(1) nothrow
+  const_iterator begin() const {
+    return {this, 0};
+  }
+
+  // O(1) nothrow
+  const_iterator end() const {
+    return {this, size_};
+  }
+
+private:
+  // directory with room for slots_ chunk pointers, allocated_ of them used
+  T** chunks_ = nullptr;
+  size_t slots_ = 0;
+  size_t allocated_ = 0;
+  // the next, twice larger directory while it is being filled; its first
+  // copied_ slots are up to date, as is every slot from the one that was
+  // next when it was allocated
+  T** next_chunks_ = nullptr;
+  size_t copied_ = 0;
+  size_t size_ = 0;
+
+  static T** allocate_directory(size_t slots) {
+    return static_cast<T**>(operator new(sizeof(T*) * slots));
+  }
+
+  void release() {
+    clear();
+    for (size_t i = 0; i < allocated_; i++) {
+      operator delete(chunks_[i]);
+    }
+    operator delete(chunks_);
+    operator delete(next_chunks_);
+  }
+
+  size_t chunk_length(size_t i) const {
+    return std::min(ChunkSize, size_ - i * ChunkSize);
+  }
+
+  void add_chunk() {
+    if (allocated_ == slots_) {
+      if (next_chunks_ == nullptr) {
+        // the first directory
+        next_chunks_ = allocate_directory(std::max<size_t>(4, slots_ * 2));
+        std::copy_n(chunks_, allocated_, next_chunks_);
+        copied_ = allocated_;
+      }
+      // every slot has been copied by now
+      operator delete(chunks_);
+      chunks_ = std::exchange(next_chunks_, nullptr);
+      slots_ = std::max<size_t>(4, slots_ * 2);
+    }
+    if (next_chunks_ == nullptr && allocated_ >= slots_ / 2) {
+      next_chunks_ = allocate_directory(slots_ * 2);
+      copied_ = 0;
+    }
+    T* chunk = static_cast<T*>(operator new(sizeof(T) * ChunkSize));
+    chunks_[allocated_] = chunk;
+    if (next_chunks_ != nullptr) {
+      next_chunks_[allocated_] = chunk;
+      // two per chunk catches up with allocated_ when it reaches slots_
+      for (int k = 0; k < 2 && copied_ < allocated_; k++, copied_++) {
+        next_chunks_[copied_] = chunks_[copied_];
+      }
+    }
+    allocated_++;
+  }
+};
@@ -1,35 +1,124 @@
 #pragma once
+#include "../telemetry/container_stats.h"
+#include <algorithm>
+#include <concepts>
 #include <cstddef>
-
-template <typename T>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+template <typename T, typename Allocator = std::allocator<T>>
 struct vector {
   using iterator = T*;
   using const_iterator = T const*;
+  using allocator_type = Allocator;
+  using stats = container_stats<vector>;
+
+private:
+  using alloc_traits = std::allocator_traits<Allocator>;
+
+  template <typename It>
+  using iterator_category_t = typename std::iterator_traits<It>::iterator_category;
+
+  template <typename It>
+  static constexpr bool is_forward_iterator =
+      std::is_base_of_v<std::forward_iterator_tag, iterator_category_t<It>>;
+
+  static constexpr bool steal_on_move_assign =
+      alloc_traits::propagate_on_container_move_assignment::value ||
+      alloc_traits::is_always_equal::value;
+
+public:
 
   // O(N) nothrow
-  vector() : data_(nullptr), size_(0), capacity_(0) {}
+  vector() noexcept(noexcept(Allocator()))
+      : vector(Allocator()) {}
+
+  // O(1) nothrow
+  explicit vector(Allocator const& alloc) noexcept
+      : data_(nullptr), size_(0), capacity_(0), alloc_(alloc) {}
 
   // O(1) strong
   vector(vector const& other)
-      : data_(nullptr), size_(other.size()), capacity_(other.size()) {
+      : vector(other,
+               alloc_traits::select_on_container_copy_construction(other.alloc_)) {}
+
+  // O(N) strong
+  vector(vector const& other, Allocator const& alloc)
+      : data_(nullptr), size_(other.size()), capacity_(other.size()),
+        alloc_(alloc) {
     if (other.size()) {
       data_ = copy_raw(other.data_, other.size_, other.size_);
     }
   }
 
+  // O(1) nothrow
+  vector(vector&& other) noexcept
+      : data_(other.data_), size_(other.size_), capacity_(other.capacity_),
+        alloc_(std::move(other.alloc_)) {
+    other.data_ = nullptr;
+    other.size_ = 0;
+    other.capacity_ = 0;
+  }
+
+  // O(1) nothrow if allocators are equal, O(N) strong otherwise
+  vector(vector&& other, Allocator const& alloc)
+      : data_(nullptr), size_(0), capacity_(0), alloc_(alloc) {
+    if (alloc_ == other.alloc_) {
+      steal(other);
+    } else {
+      insert(end(), std::make_move_iterator(other.begin()),
+             std::make_move_iterator(other.end()));
+    }
+  }
+
   // O(N) strong
   vector& operator=(vector const& other) {
     if (this == &other) {
       return *this;
     }
-    vector(other).swap(*this);
+    if constexpr (alloc_traits::propagate_on_container_copy_assignment::value) {
+      vector tmp(other, other.alloc_);
+      swap_with_allocator(tmp);
+    } else {
+      vector(other, alloc_).swap(*this);
+    }
+    return *this;
+  }
+
+  // O(N) nothrow if allocators propagate or are equal, strong otherwise
+  vector& operator=(vector&& other) noexcept(steal_on_move_assign) {
+    if (this == &other) {
+      return *this;
+    }
+    if constexpr (alloc_traits::propagate_on_container_move_assignment::value) {
+      vector tmp(std::move(other));
+      swap_with_allocator(tmp);
+    } else if (steal_on_move_assign || alloc_ == other.alloc_) {
+      vector tmp(alloc_);
+      tmp.steal(other);
+      swap(tmp);
+    } else {
+      vector tmp(std::move(other), alloc_);
+      swap(tmp);
+    }
     return *this;
   }
 
   // O(N) nothrow
   ~vector() {
-    clear();
-    operator delete(data_);
+    note_capacity();
+    clean_up(data_, size_, capacity_);
+  }
+
+  // O(1) nothrow
+  allocator_type get_allocator() const {
+    return alloc_;
   }
 
   // O(1) nothrow
@@ -79,26 +168,57 @@ struct vector {
 
   // O(1)* strong
   void push_back(T const& element) {
+    emplace_back(element);
+  }
+
+  // O(1)* strong
+  void push_back(T&& element) {
+    emplace_back(std::move(element));
+  }
+
+  // O(1)* strong
+  template <typename... Args>
+  T& emplace_back(Args&&... args) {
+    if constexpr (reallocatable) {
+      if (size() == capacity()) {
+        // args may refer to elements of *this, which may move
+        T element(std::forward<Args>(args)...);
+        copy_and_recapas(size_ == 0 ? 1 : (size_ << 1));
+        construct(end(), std::move(element));
+        return data_[size_++];
+      }
+    }
     if (size() == capacity()) {
-      capacity_ = (size_ == 0 ? 1 : (size_ << 1));
-      T* tmp = copy_raw(data_, size(), capacity());
+      size_t new_cap = (size_ == 0 ? 1 : (size_ << 1));
+      T* tmp = allocate(new_cap);
+      // the new element goes first: args may refer to elements of *this
       try {
-        new (tmp + size_) T(element);
+        construct(tmp + size_, std::forward<Args>(args)...);
       } catch (...) {
-        clean_up(tmp, size());
+        deallocate(tmp, new_cap);
         throw;
       }
-      clean_up(data_, size());
+      try {
+        relocate_raw(data_, size(), tmp);
+      } catch (...) {
+        clean_up(tmp + size_, 1, 0);
+        deallocate(tmp, new_cap);
+        throw;
+      }
+      clean_up(data_, size(), capacity());
       data_ = tmp;
-    } else {
-      new (end()) T(element);
+      capacity_ = new_cap;
+      size_++;
+      note_capacity();
+      return data_[size_ - 1];
     }
-    size_++;
+    construct(end(), std::forward<Args>(args)...);
+    return data_[size_++];
   }
 
   // O(1) nothrow
   void pop_back() {
-    back().~T();
+    alloc_traits::destroy(alloc_, end() - 1);
     size_--;
   }
 
@@ -122,7 +242,7 @@ struct vector {
   // O(N) strong
   void shrink_to_fit() {
     if (size() == 0) {
-      operator delete(data_);
+      deallocate(data_, capacity_);
       data_ = nullptr;
       capacity_ = 0;
     } else if (size() != capacity()) {
@@ -132,13 +252,85 @@ struct vector {
 
   // O(N) nothrow
   void clear() {
-    while (!empty()) {
-      pop_back();
+    clean_up(data_, size_, 0);
+    size_ = 0;
+  }
+
+  // O(N) strong
+  void resize(size_t new_size) {
+    if (new_size <= size()) {
+      erase(begin() + new_size, end());
+    } else {
+      size_t n = new_size - size();
+      insert_raw(size(), n, [this, n](T* to) { construct_n(to, n); });
+    }
+  }
+
+  // O(N) strong
+  void resize(size_t new_size, T const& value) {
+    if (new_size <= size()) {
+      erase(begin() + new_size, end());
+    } else {
+      insert(end(), new_size - size(), value);
+    }
+  }
+
+  // O(N + n) strong if n > capacity, basic otherwise
+  void assign(size_t n, T const& value) {
+    if (n > capacity()) {
+      vector tmp(alloc_);
+      tmp.insert(tmp.end(), n, value);
+      swap(tmp);
+      return;
+    }
+    std::fill_n(data_, std::min(n, size()), value);
+    if (n > size()) {
+      construct_n(data_ + size_, n - size_, value);
+    } else {
+      clean_up(data_ + n, size_ - n, 0);
+    }
+    size_ = n;
+  }
+
+  // O(N + n) strong if n > capacity, basic otherwise
+  template <typename It, typename = iterator_category_t<It>>
+  void assign(It first, It last) {
+    if constexpr (!is_forward_iterator<It>) {
+      vector tmp(alloc_);
+      tmp.insert(tmp.end(), first, last);
+      swap(tmp);
+    } else {
+      size_t n = std::distance(first, last);
+      if (n > capacity()) {
+        vector tmp(alloc_);
+        tmp.insert(tmp.end(), first, last);
+        swap(tmp);
+        return;
+      }
+      size_t common = std::min(n, size());
+      It mid = std::next(first, common);
+      std::copy(first, mid, data_);
+      if (n > size()) {
+        construct_from(mid, last, data_ + size_);
+      } else {
+        clean_up(data_ + n, size_ - n, 0);
+      }
+      size_ = n;
     }
   }
 
+  // O(n)* strong
+  template <typename Range>
+  void append_range(Range&& range) {
+    insert(end(), std::begin(range), std::end(range));
+  }
+
   // O(1) nothrow
   void swap(vector& other) {
+    if constexpr (alloc_traits::propagate_on_container_swap::value) {
+      using std::swap;
+      swap(alloc_, other.alloc_);
+    }
     std::swap(this->data_, other.data_);
     std::swap(this->size_, other.size_);
     std::swap(this->capacity_, other.capacity_);
@@ -166,29 +358,70 @@ struct vector {
 
   // O(N) strong
   iterator insert(const_iterator pos, T const& element) {
+    return insert(pos, 1, element);
+  }
+
+  // O(N) strong
+  iterator insert(const_iterator pos, T&& element) {
+    return insert_raw(pos - begin(), 1, [this, &element](T* to) {
+      construct(to, std::move(element));
+    });
+  }
+
+  // O(N + n) strong
+  iterator insert(const_iterator pos, size_t n, T const& element) {
     size_t insert_pos = pos - begin();
-    push_back(element);
-    for (size_t i = size() - 1; i != insert_pos; i--) {
-      std::swap(data_[i], data_[i - 1]);
+    if (std::less_equal<T const*>()(begin(), &element) &&
+        std::less<T const*>()(&element, end())) {
+      T copy(element);
+      return insert_raw(insert_pos, n,
+                        [this, n, &copy](T* to) { construct_n(to, n, copy); });
     }
-    return &data_[insert_pos];
-  };
+    return insert_raw(insert_pos, n,
+                      [this, n, &element](T* to) { construct_n(to, n, element); });
+  }
 
-  // O(N) nothrow(swap)
+  // O(N + n) strong
+  template <typename It, typename = iterator_category_t<It>>
+  iterator insert(const_iterator pos, It first, It last) {
+    size_t insert_pos = pos - begin();
+    if constexpr (!is_forward_iterator<It>) {
+      vector tmp(alloc_);
+      for (; first != last; ++first) {
+        tmp.emplace_back(*first);
+      }
+      return insert_raw(insert_pos, tmp.size(), [this, &tmp](T* to) {
+        construct_from(std::make_move_iterator(tmp.begin()),
+                       std::make_move_iterator(tmp.end()), to);
+      });
+    } else {
+      return insert_raw(insert_pos, std::distance(first, last),
+                        [this, first, last](T* to) {
+                          construct_from(first, last, to);
+                        });
+    }
+  }
+
+  // O(N) nothrow(move)
   iterator erase(const_iterator pos) {
     return erase(pos, pos + 1);
   };
 
-  // O(N) nothrow(swap)
+  // O(N) nothrow(move)
   iterator erase(const_iterator first, const_iterator last) {
     size_t beg = first - begin();
     size_t len = last - first;
-    for (size_t i = beg; i + len < size(); i++) {
-      std::swap(data_[i], data_[i + len]);
+    if (len == 0) {
+      return &data_[beg];
     }
-    for (size_t i = 0; i < len; i++) {
-      pop_back();
+    if constexpr (trivially_relocatable) {
+      std::memmove(static_cast<void*>(data_ + beg), data_ + beg + len,
+                   sizeof(T) * (size_ - beg - len));
+    } else {
+      std::move(data_ + beg + len, data_ + size_, data_ + beg);
+      clean_up(data_ + size_ - len, len, 0);
     }
+    size_ -= len;
     return &data_[beg];
   };
 
@@ -196,35 +429,221 @@ private:
   T* data_;
   size_t size_;
   size_t capacity_;
+  [[no_unique_address]] Allocator alloc_;
+
+  static constexpr bool trivially_relocatable = std::is_trivially_copyable_v<T>;
+
+  // What std::move_if_noexcept picks when elements change buffers: move,
+  // unless moving may throw and a copy is possible.
+  static constexpr bool relocate_by_move =
+      trivially_relocatable || std::is_nothrow_move_constructible_v<T> ||
+      !std::is_copy_constructible_v<T>;
+
+  // Allocators such as mmap_allocator can resize a buffer in place.
+  static constexpr bool reallocatable =
+      trivially_relocatable && requires(Allocator& a, T* p, size_t n) {
+        { a.reallocate(p, n, n, n) } -> std::same_as<T*>;
+      };
+
+  T* allocate(size_t capacity) {
+    T* res = alloc_traits::allocate(alloc_, capacity);
+    stats::on_allocation(capacity * sizeof(T));
+    return res;
+  }
+
+  void deallocate(T* from, size_t capacity) {
+    if (from != nullptr) {
+      alloc_traits::deallocate(alloc_, from, capacity);
+    }
+  }
+
+  template <typename... Args>
+  void construct(T* to, Args&&... args) {
+    alloc_traits::construct(alloc_, to, std::forward<Args>(args)...);
+  }
+
+  // Destroys sz elements and, if capacity is not zero, frees the buffer.
+  void clean_up(iterator from, size_t sz, size_t capacity) {
+    if constexpr (!std::is_trivially_destructible_v<T>) {
+      for (size_t i = sz; i > 0; i--) {
+        alloc_traits::destroy(alloc_, from + i - 1);
+      }
+    }
+    if (capacity != 0) {
+      deallocate(from, capacity);
+    }
+  }
 
-  static void clean_up(iterator from, size_t sz) {
-    for (size_t i = sz; i > 0; i--) {
-      from[i - 1].~T();
+  // Builds n elements from args at to, all or none.
+  template <typename... Args>
+  void construct_n(T* to, size_t n, Args const&... args) {
+    size_t i = 0;
+    try {
+      for (; i < n; i++) {
+        construct(to + i, args...);
+      }
+    } catch (...) {
+      clean_up(to, i, 0);
+      throw;
     }
-    operator delete(from);
   }
 
-  static iterator copy_raw(iterator from, size_t sz, size_t capacity) {
-    T* tmp = static_cast<T*>(operator new(sizeof(T) * capacity));
-    size_t new_sz = 0;
+  // Builds elements from [first, last) at to, all or none.
+  template <typename It>
+  void construct_from(It first, It last, T* to) {
+    size_t i = 0;
     try {
-      for (; new_sz < sz; new_sz++) {
-        new (tmp + new_sz) T(from[new_sz]);
+      for (; first != last; ++first, ++i) {
+        construct(to + i, *first);
+      }
+    } catch (...) {
+      clean_up(to, i, 0);
+      throw;
+    }
+  }
+
+  void note_capacity() const {
+    stats::on_capacity(size_ * sizeof(T), capacity_ * sizeof(T));
+  }
+
+  void steal(vector& other) noexcept {
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+    std::swap(capacity_, other.capacity_);
+  }
+
+  void swap_with_allocator(vector& other) noexcept {
+    using std::swap;
+    swap(alloc_, other.alloc_);
+    steal(other);
+  }
+
+  // Moves sz elements between possibly overlapping ranges of one buffer,
+  // destroying the sources. Only used when moving cannot throw.
+  void relocate_within(iterator from, size_t sz, iterator to) {
+    if constexpr (trivially_relocatable) {
+      if (sz != 0) {
+        std::memmove(static_cast<void*>(to), from, sizeof(T) * sz);
       }
+    } else if (to > from) {
+      for (size_t i = sz; i > 0; i--) {
+        construct(to + i - 1, std::move(from[i - 1]));
+        alloc_traits::destroy(alloc_, from + i - 1);
+      }
+    } else {
+      for (size_t i = 0; i < sz; i++) {
+        construct(to + i, std::move(from[i]));
+        alloc_traits::destroy(alloc_, from + i);
+      }
+    }
+  }
+
+  // Moves sz elements into raw memory, or copies them if relocate_by_move
+  // says so, and reports which one it did to the growth counters. Leaves
+  // `from` untouched on exception whenever T is copyable, so callers keep
+  // the strong guarantee; `to` is not freed.
+  void relocate_raw(iterator from, size_t sz, T* to) {
+    if constexpr (trivially_relocatable) {
+      stats::on_growth(0, sz);
+      if (sz != 0) {
+        std::memcpy(static_cast<void*>(to), from, sizeof(T) * sz);
+      }
+    } else if constexpr (relocate_by_move) {
+      stats::on_growth(0, sz);
+      construct_from(std::make_move_iterator(from),
+                     std::make_move_iterator(from + sz), to);
+    } else {
+      stats::on_growth(sz, 0);
+      construct_from(from, from + sz, to);
+    }
+  }
+
+  iterator copy_raw(iterator from, size_t sz, size_t capacity) {
+    T* tmp = allocate(capacity);
+    try {
+      construct_from(from, from + sz, tmp);
     } catch (...) {
-      clean_up(tmp, new_sz);
+      deallocate(tmp, capacity);
       throw;
     }
     return tmp;
   }
 
+  // Opens a gap of n elements at pos and fills it with build(gap),
+  // which must build all n elements or none. Reallocates at most once and
+  // shifts the tail once; the vector is unchanged if build throws.
+  template <typename Build>
+  iterator insert_raw(size_t pos, size_t n, Build build) {
+    if (n == 0) {
+      return data_ + pos;
+    }
+    if (reallocatable && size_ + n > capacity_) {
+      copy_and_recapas(std::max(size_ + n, capacity_ << 1));
+    }
+    if (size_ + n > capacity_ || !std::is_nothrow_move_constructible_v<T>) {
+      size_t new_cap =
+          size_ + n > capacity_ ? std::max(size_ + n, capacity_ << 1) : capacity_;
+      T* tmp = allocate(new_cap);
+      try {
+        build(tmp + pos);
+      } catch (...) {
+        deallocate(tmp, new_cap);
+        throw;
+      }
+      try {
+        relocate_raw(data_, pos, tmp);
+        try {
+          relocate_raw(data_ + pos, size_ - pos, tmp + pos + n);
+        } catch (...) {
+          clean_up(tmp, pos, 0);
+          throw;
+        }
+      } catch (...) {
+        clean_up(tmp + pos, n, 0);
+        deallocate(tmp, new_cap);
+        throw;
+      }
+      clean_up(data_, size_, capacity_);
+      data_ = tmp;
+      capacity_ = new_cap;
+      size_ += n;
+      note_capacity();
+      return data_ + pos;
+    }
+    relocate_within(data_ + pos, size_ - pos, data_ + pos + n);
+    try {
+      build(data_ + pos);
+    } catch (...) {
+      relocate_within(data_ + pos + n, size_ - pos, data_ + pos);
+      throw;
+    }
+    size_ += n;
+    return data_ + pos;
+  }
+
   void copy_and_recapas(size_t cap) {
-    T* tmp = copy_raw(data_, size(), cap);
-    for (size_t i = size(); i > 0; i--) {
-      data_[i - 1].~T();
+    if constexpr (reallocatable) {
+      data_ = alloc_.reallocate(data_, capacity_, cap, size_);
+      stats::on_allocation(cap * sizeof(T));
+      capacity_ = cap;
+      note_capacity();
+      return;
     }
-    std::swap(data_, tmp);
-    operator delete(tmp);
+    T* tmp = allocate(cap);
+    try {
+      relocate_raw(data_, size(), tmp);
+    } catch (...) {
+      deallocate(tmp, cap);
+      throw;
+    }
+    clean_up(data_, size(), capacity());
+    data_ = tmp;
     capacity_ = cap;
+    note_capacity();
   }
-};
\ No newline at end of file
+};
+
+namespace pmr {
+template <typename T>
+using vector = ::vector<T, std::pmr::polymorphic_allocator<T>>;
+} // namespace pmr